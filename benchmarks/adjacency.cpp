@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+using namespace petri;
+using namespace std;
+
+using petri_graph = graph<place, transition, token, state<token> >;
+
+// The successors of n found by scanning every arc, which is how the queries
+// behaved before the graph kept adjacency lists.
+vector<petri::iterator> scan_next(const petri_graph &g, petri::iterator n) {
+	vector<petri::iterator> result;
+	for (auto a = g.arcs[n.type].begin(); a != g.arcs[n.type].end(); a++)
+		if (a->from == n)
+			result.push_back(a->to);
+	return result;
+}
+
+vector<petri::iterator> scan_prev(const petri_graph &g, petri::iterator n) {
+	vector<petri::iterator> result;
+	for (auto a = g.arcs[1-n.type].begin(); a != g.arcs[1-n.type].end(); a++)
+		if (a->to == n)
+			result.push_back(a->from);
+	return result;
+}
+
+TEST(adjacency, queries) {
+	// Alternate an edit with a handful of neighborhood queries on a large
+	// ring, comparing the old arc scan against the adjacency lists.
+	const int size = 2000;
+	const int steps = 500;
+
+	petri_graph g;
+	auto p = g.create(place(), size);
+	auto t = g.create(transition(), size);
+	for (int i = 0; i < size; i++) {
+		g.connect(t[i], p[i]);
+		g.connect(p[i], t[(i+1)%size]);
+	}
+
+	chrono::duration<double> scan(0), adj(0);
+	for (int i = 0; i < steps; i++) {
+		g.insert_after(t[(i*7)%size], place());
+
+		vector<petri::iterator> expect, actual;
+		auto start = chrono::steady_clock::now();
+		for (int j = 0; j < 16; j++) {
+			petri::iterator n(j%2, (i*13 + j*31)%size);
+			vector<petri::iterator> a = scan_next(g, n), b = scan_prev(g, n);
+			expect.insert(expect.end(), a.begin(), a.end());
+			expect.insert(expect.end(), b.begin(), b.end());
+		}
+		auto mid = chrono::steady_clock::now();
+		for (int j = 0; j < 16; j++) {
+			petri::iterator n(j%2, (i*13 + j*31)%size);
+			vector<petri::iterator> a = g.next(n), b = g.prev(n);
+			actual.insert(actual.end(), a.begin(), a.end());
+			actual.insert(actual.end(), b.begin(), b.end());
+		}
+		auto end = chrono::steady_clock::now();
+		scan += mid - start;
+		adj += end - mid;
+
+		EXPECT_EQ(expect, actual);
+	}
+
+	cout << "arc scan: " << scan.count()*1e3 << "ms, adjacency lists: " << adj.count()*1e3 << "ms" << endl;
+}
@@ -0,0 +1,33 @@
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// These replace the global operators for the whole benchmark binary. They
+// are kept in their own file so that they are never inlined into the code
+// that calls them.
+static atomic<int64_t> allocated(0);
+
+int64_t allocations() {
+	return allocated;
+}
+
+void *operator new(size_t size) {
+	allocated++;
+	void *result = malloc(size == 0 ? 1 : size);
+	if (result == nullptr) {
+		throw bad_alloc();
+	}
+	return result;
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
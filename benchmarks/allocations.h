@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// The number of allocations made by the benchmark binary so far. Every
+// allocation through the global operator new is counted, so the benchmarks
+// can check which queries allocate.
+int64_t allocations();
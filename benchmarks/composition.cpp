@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+#include "nets.h"
+
+using namespace petri;
+using namespace std;
+
+TEST(composition, split_groups) {
+	// A long ring of parallel fork/join stages. Every split reaches across
+	// the whole ring, so scanning every node in each round of the forward
+	// traversal costs O(N) per round.
+	const int stages = 300;
+
+	petri_graph g = make_ring(stages);
+
+	auto start = chrono::steady_clock::now();
+	g.compute_split_groups();
+	auto end = chrono::steady_clock::now();
+
+	EXPECT_EQ(1u, g.split_groups_of(parallel, g.next(petri::iterator(transition::type, 0))[0]).size());
+	cout << "split groups: " << chrono::duration<double>(end - start).count()*1e3 << "ms" << endl;
+}
+
+TEST(composition, relations) {
+	// Every pair of nodes in a ring of parallel fork/join stages, queried by
+	// comparing split groups, through the memoized comparisons and through the
+	// relation cache.
+	const int stages = 60;
+
+	petri_graph g0 = make_ring(stages);
+	g0.compute_split_groups();
+
+	petri_graph g1 = g0;
+	g1.set_relation_cache(true);
+	petri_graph g2 = g0;
+	g2.set_compare_memo(true);
+	g0.set_signature_stats(true);
+
+	vector<petri::iterator> nodes;
+	for (int type = 0; type < 2; type++) {
+		for (petri::iterator i = g0.begin(type); i != g0.end(type); i++) {
+			nodes.push_back(i);
+		}
+	}
+
+	int count0 = 0, count1 = 0, count2 = 0;
+	auto start = chrono::steady_clock::now();
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			count0 += g0.is(parallel, *a, *b) + g0.is(choice, *a, *b, true) + g0.is(sequence, *a, *b);
+		}
+	}
+	auto mid = chrono::steady_clock::now();
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			count1 += g1.is(parallel, *a, *b) + g1.is(choice, *a, *b, true) + g1.is(sequence, *a, *b);
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			count2 += g2.is(parallel, *a, *b) + g2.is(choice, *a, *b, true) + g2.is(sequence, *a, *b);
+		}
+	}
+	auto memo = chrono::steady_clock::now();
+
+	EXPECT_EQ(count0, count1);
+	EXPECT_EQ(count0, count2);
+	cout << "split groups: " << chrono::duration<double>(mid - start).count()*1e3 << "ms, relation cache: " << chrono::duration<double>(end - mid).count()*1e3 << "ms, "
+	     << "memoized: " << chrono::duration<double>(memo - end).count()*1e3 << "ms, "
+	     << "signature hit rate: " << g0.signature_hit_rate() << endl;
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <set>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+#include "nets.h"
+
+using namespace petri;
+using namespace std;
+
+// The distance traversal as it was before the predecessor lists were shared
+// between sources: rebuild them from the arcs and track visited nodes in a set.
+vector<int> reference_row(const petri_graph &g, petri::iterator pos) {
+	set<petri::iterator> seen;
+
+	array<vector<vector<petri::iterator> >, 2> p;
+	p[place::type].resize(g.places.size());
+	p[transition::type].resize(g.transitions.size());
+	for (int type = 0; type < 2; type++) {
+		for (int i = 0; i < (int)g.arcs[type].size(); i++) {
+			p[1-type][g.arcs[type][i].to.index].push_back(g.arcs[type][i].from);
+		}
+	}
+
+	int nodes = (int)(g.places.size() + g.transitions.size());
+	int offset = (int)g.places.size();
+	vector<int> row(nodes, std::numeric_limits<int>::min());
+	row[offset*pos.type + pos.index] = 0;
+
+	vector<petri::iterator> stack;
+	stack.push_back(pos);
+	seen.insert(pos);
+	while (not stack.empty()) {
+		petri::iterator curr = stack.back();
+		stack.pop_back();
+
+		int toIdx = offset*curr.type + curr.index;
+		for (auto i = p[curr.type][curr.index].begin(); i != p[curr.type][curr.index].end(); i++) {
+			int fromIdx = offset*i->type + i->index;
+			if (seen.insert(*i).second) {
+				row[fromIdx] = max(row[fromIdx], row[toIdx] + 1);
+				stack.push_back(*i);
+			}
+		}
+	}
+	return row;
+}
+
+void benchmark_distance(const char *name, const petri_graph &g) {
+	const int samples = 100;
+	int nodes = (int)(g.places.size() + g.transitions.size());
+	int offset = (int)g.places.size();
+
+	auto start = chrono::steady_clock::now();
+	g.update_node_distances();
+	chrono::duration<double> pass = chrono::steady_clock::now() - start;
+
+	start = chrono::steady_clock::now();
+	vector<vector<int> > expect;
+	for (int i = 0; i < samples; i++) {
+		int idx = (int)((long long)i*nodes/samples);
+		expect.push_back(reference_row(g, idx < offset ? petri::iterator(place::type, idx) : petri::iterator(transition::type, idx-offset)));
+	}
+	chrono::duration<double> reference = chrono::steady_clock::now() - start;
+
+	for (int i = 0; i < samples; i++) {
+		int idx = (int)((long long)i*nodes/samples);
+		EXPECT_EQ(expect[i], g.node_distances.load_row(idx)) << name << " row " << idx;
+	}
+
+	cout << name << ": " << nodes << " nodes, whole-net pass " << pass.count()*1e3 << "ms, "
+	     << "previous traversal " << reference.count()*1e3/samples*nodes << "ms (projected from " << samples << " sources)" << endl;
+}
+
+TEST(distance, ring) {
+	petri_graph g;
+
+	const int size = 5000;
+	auto p = g.create(place(), size);
+	auto t = g.create(transition(), size);
+	for (int i = 0; i < size; i++) {
+		g.connect(t[i], p[i]);
+		g.connect(p[i], t[(i+1)%size]);
+	}
+
+	benchmark_distance("ring", g);
+}
+
+TEST(distance, fork_join) {
+	petri_graph g;
+
+	// seven nodes per stage
+	const int stages = 1430;
+	petri::iterator first = g.create(transition());
+	petri::iterator prev = first;
+	for (int i = 0; i < stages; i++) {
+		auto p = g.create(place(), 4);
+		auto t = g.create(transition(), 3);
+		g.connect({prev, p[0], t[0], p[1], t[2]});
+		g.connect({prev, p[2], t[1], p[3], t[2]});
+		prev = t[2];
+	}
+	auto p = g.create(place());
+	g.connect({prev, p, first});
+
+	benchmark_distance("fork-join", g);
+}
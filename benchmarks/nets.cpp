@@ -0,0 +1,47 @@
+#include "nets.h"
+
+using namespace petri;
+using namespace std;
+
+petri_graph make_ring(int stages) {
+	petri_graph g;
+	auto fork = g.create(transition(), stages);
+	auto join = g.create(transition(), stages);
+	for (int i = 0; i < stages; i++) {
+		auto a = g.create(place(), 2);
+		auto b = g.create(place(), 2);
+		g.connect({fork[i], a[0], join[i]});
+		g.connect({fork[i], b[0], join[i]});
+		g.connect({fork[i], a[1], join[i]});
+		g.connect({fork[i], b[1], join[i]});
+		petri::iterator link = g.create(place());
+		g.connect({join[i], link, fork[(i+1)%stages]});
+		if (i == stages-1) {
+			g.reset.push_back(state<token>({token(link.index)}));
+		}
+	}
+	return g;
+}
+
+petri_graph make_branches(int branches, int length, vector<petri::iterator> &places) {
+	petri_graph g;
+	petri::iterator fork = g.create(transition());
+	petri::iterator join = g.create(transition());
+	for (int i = 0; i < branches; i++) {
+		petri::iterator prev = fork;
+		for (int j = 0; j < length; j++) {
+			petri::iterator p = g.create(place());
+			places.push_back(p);
+			g.connect(prev, p);
+			prev = g.create(transition());
+			g.connect(p, prev);
+		}
+		g.connect(prev, g.create(place()));
+		g.connect(petri::iterator(place::type, g.size(place::type)-1), join);
+	}
+	petri::iterator link = g.create(place());
+	g.connect({join, link, fork});
+	g.reset.push_back(state<token>({token(link.index)}));
+	g.compute_split_groups();
+	return g;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+using petri_graph = petri::graph<petri::place, petri::transition, petri::token, petri::state<petri::token> >;
+
+// The nets shared by the benchmarks
+
+// A ring of parallel fork/join stages
+petri_graph make_ring(int stages);
+
+// A ring through a fork into the given number of parallel branches, each a
+// chain of the given number of places, and a join. The places of the chains
+// are added to places.
+petri_graph make_branches(int branches, int length, std::vector<petri::iterator> &places);
@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+#include "nets.h"
+
+using namespace petri;
+using namespace std;
+
+TEST(select, cliques) {
+	vector<petri::iterator> places;
+	auto g = make_branches(6, 4, places);
+	for (int threads : {1, 0}) {
+		auto h = g;
+		h.set_threads(threads);
+		auto start = chrono::steady_clock::now();
+		vector<vector<petri::iterator> > result = h.select(parallel, places);
+		auto end = chrono::steady_clock::now();
+		EXPECT_EQ(4096, (int)result.size());
+		cout << h.threads() << " threads: " << places.size() << " nodes, " << result.size() << " cliques in " << chrono::duration<double>(end - start).count()*1e3 << "ms" << endl;
+	}
+}
+
+TEST(select, partials) {
+	// The partials of a wide parallel region grow exponentially with the
+	// number of branches
+	vector<petri::iterator> places;
+	auto g = make_branches(6, 2, places);
+	for (int threads : {1, 0}) {
+		auto h = g;
+		h.set_threads(threads);
+		auto start = chrono::steady_clock::now();
+		vector<vector<petri::iterator> > result = h.partials(parallel, {});
+		auto end = chrono::steady_clock::now();
+		EXPECT_EQ(6*6*6*6*6*6 + 3, (int)result.size());
+		cout << h.threads() << " threads: " << result.size() << " partials in " << chrono::duration<double>(end - start).count()*1e3 << "ms" << endl;
+	}
+}
@@ -0,0 +1,228 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+#include "allocations.h"
+#include "nets.h"
+
+using namespace petri;
+using namespace std;
+
+// merge_inplace() as it was before it was made linear, editing g0 with
+// vector insert and erase.
+void reference_merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, const vector<split_group> &g1, set<int> exclude) {
+	int i = 0, j = 0;
+	while (i < (int)g0.size() or j < (int)g1.size()) {
+		while (j < (int)g1.size() and exclude.find(g1[j].split) != exclude.end()) {
+			j++;
+		}
+
+		if (i < (int)g0.size() and j < (int)g1.size() and g0[i].split == g1[j].split) {
+			int k = 0, l = 0;
+			while (k < (int)g0[i].branch.size() or l < (int)g1[j].branch.size()) {
+				if (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size() and g0[i].branch[k] == g1[j].branch[l]) {
+					k++;
+					l++;
+				} else if (k < (int)g0[i].branch.size() and (l >= (int)g1[j].branch.size() or g0[i].branch[k] < g1[j].branch[l])) {
+					if (branch_operation == split_group::INTERSECT) {
+						g0[i].branch.erase(g0[i].branch.begin()+k);
+					} else {
+						k++;
+					}
+				} else if (l < (int)g1[j].branch.size()) {
+					if (branch_operation == split_group::UNION) {
+						g0[i].branch.insert(g0[i].branch.begin()+k, g1[j].branch[l]);
+						k++;
+					}
+					l++;
+				}
+			}
+			i++;
+			j++;
+		} else if (i < (int)g0.size() and (j >= (int)g1.size() or g0[i].split < g1[j].split)) {
+			if (group_operation == split_group::INTERSECT) {
+				g0.erase(g0.begin()+i);
+			} else {
+				i++;
+			}
+		} else if (j < (int)g1.size()) {
+			if (group_operation == split_group::UNION) {
+				g0.insert(g0.begin()+i, g1[j]);
+				i++;
+			}
+			j++;
+		}
+	}
+}
+
+// Sorted split groups with random splits and branches. Branch j is the
+// j'th successor of its split, so it is also bit j of the mask.
+vector<split_group> random_groups(int splits, int groups, int branches, bool masked = false) {
+	vector<split_group> result;
+	for (int i = 0; i < splits and (int)result.size() < groups; i++) {
+		if (rand()%splits < groups) {
+			split_group group(i, branches);
+			if (masked) {
+				group.mask.assign((branches+63)/64, 0);
+			}
+			for (int j = 0; j < branches; j++) {
+				if (rand()%2) {
+					group.branch.push_back(j);
+					if (masked) {
+						group.set_mask(j);
+					}
+				}
+			}
+			result.push_back(group);
+		}
+	}
+	return result;
+}
+
+vector<split_group> strip_masks(vector<split_group> groups) {
+	for (auto g = groups.begin(); g != groups.end(); g++) {
+		g->mask.clear();
+	}
+	return groups;
+}
+
+const vector<int> compare_groups = {
+	split_group::INTERSECT, split_group::DIFFERENCE, split_group::NEGATIVE_DIFFERENCE,
+	split_group::SYMMETRIC_DIFFERENCE, split_group::SUBSET, split_group::SUBSET_EQUAL};
+const vector<int> compare_branches = {
+	split_group::INTERSECT, split_group::DIFFERENCE, split_group::NEGATIVE_DIFFERENCE,
+	split_group::SYMMETRIC_DIFFERENCE, split_group::SUBSET, split_group::SUBSET_EQUAL,
+	split_group::NOT_EQUAL};
+
+const vector<int> group_operations = {split_group::INTERSECT, split_group::UNION};
+const vector<int> branch_operations = {split_group::INTERSECT, split_group::UNION, split_group::DIFFERENCE};
+
+TEST(split_group, allocations) {
+	// Every pair of nodes of a ring is queried, first by copying the split
+	// groups of both nodes, then through the relation queries, which should
+	// not allocate at all once the split groups are packed.
+	petri_graph g = make_ring(40);
+	g.compute_split_groups();
+	g.update_split_pools();
+
+	vector<petri::iterator> nodes;
+	for (int type = 0; type < 2; type++) {
+		for (petri::iterator i = g.begin(type); i != g.end(type); i++) {
+			nodes.push_back(i);
+		}
+	}
+
+	int count0 = 0, count1 = 0;
+	int64_t start0 = allocations();
+	auto start = chrono::steady_clock::now();
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			vector<split_group> ap = g.split_groups_of(parallel, *a);
+			vector<split_group> bp = g.split_groups_of(parallel, *b);
+			count0 += (*a != *b and compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ap, bp));
+		}
+	}
+	auto mid = chrono::steady_clock::now();
+	int64_t copies = allocations() - start0;
+
+	int64_t start1 = allocations();
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			count1 += g.is(parallel, *a, *b);
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	int64_t views = allocations() - start1;
+
+	EXPECT_EQ(count0, count1);
+	EXPECT_EQ(0, views);
+	cout << "copies: " << copies << " allocations in " << chrono::duration<double>(mid - start).count()*1e3 << "ms, "
+	     << "views: " << views << " allocations in " << chrono::duration<double>(end - mid).count()*1e3 << "ms" << endl;
+}
+
+TEST(split_group, operations) {
+	// Time every pair of operations of compare(), merge() and merge_inplace()
+	// on large random split groups.
+	const int iterations = 200;
+	srand(1);
+	vector<vector<split_group> > g;
+	for (int i = 0; i < 8; i++) {
+		g.push_back(random_groups(1024, 256, 64));
+	}
+
+	auto report = [](string name, int group_operation, int branch_operation, chrono::duration<double> time) {
+		cout << name << "(" << group_operation << ", " << branch_operation << "): " << time.count()*1e9/iterations << "ns" << endl;
+	};
+
+	int found = 0;
+
+	// Wide splits, comparing the branch lists against the branch masks
+	vector<vector<split_group> > wide, masked;
+	for (int i = 0; i < 8; i++) {
+		masked.push_back(random_groups(64, 32, 512, true));
+		wide.push_back(strip_masks(masked.back()));
+	}
+	for (int branch_operation : compare_branches) {
+		auto start = chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			found += compare(split_group::INTERSECT, branch_operation, wide[i%8], wide[(i+1)%8]);
+		}
+		auto mid = chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			found += compare(split_group::INTERSECT, branch_operation, masked[i%8], masked[(i+1)%8]);
+		}
+		auto end = chrono::steady_clock::now();
+		report("wide compare lists", split_group::INTERSECT, branch_operation, mid - start);
+		report("wide compare masks", split_group::INTERSECT, branch_operation, end - mid);
+	}
+
+	for (int group_operation : compare_groups) {
+		for (int branch_operation : compare_branches) {
+			auto start = chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) {
+				found += compare(group_operation, branch_operation, g[i%8], g[(i+1)%8]);
+			}
+			report("compare", group_operation, branch_operation, chrono::steady_clock::now() - start);
+		}
+	}
+
+	vector<split_group> result, scratch;
+	for (int group_operation : group_operations) {
+		for (int branch_operation : branch_operations) {
+			auto start = chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) {
+				petri::merge(group_operation, branch_operation, g[i%8], g[(i+1)%8], result);
+				found += (int)result.size();
+			}
+			report("merge", group_operation, branch_operation, chrono::steady_clock::now() - start);
+		}
+	}
+
+	// against the old implementation of merge_inplace()
+	for (int group_operation : group_operations) {
+		for (int branch_operation : branch_operations) {
+			chrono::duration<double> time(0), reference(0);
+			for (int i = 0; i < iterations; i++) {
+				result = g[i%8];
+				auto start = chrono::steady_clock::now();
+				merge_inplace(group_operation, branch_operation, result, g[(i+1)%8], span<const int>(), scratch);
+				time += chrono::steady_clock::now() - start;
+				found += (int)result.size();
+
+				result = g[i%8];
+				start = chrono::steady_clock::now();
+				reference_merge_inplace(group_operation, branch_operation, result, g[(i+1)%8], set<int>());
+				reference += chrono::steady_clock::now() - start;
+			}
+			report("merge_inplace", group_operation, branch_operation, time);
+			report("reference_merge_inplace", group_operation, branch_operation, reference);
+		}
+	}
+	EXPECT_GT(found, 0);
+}
@@ -0,0 +1,302 @@
+#include "clique.h"
+
+#include <bit>
+#include <chrono>
+
+namespace petri
+{
+
+clique_graph::clique_graph()
+{
+	vertices = 0;
+	words = 0;
+}
+
+clique_graph::clique_graph(int vertices)
+{
+	this->vertices = vertices;
+	this->words = (vertices+63)/64;
+	rows.assign((int64_t)vertices*words, 0);
+}
+
+clique_graph::~clique_graph()
+{
+}
+
+void clique_graph::connect(int from, int to)
+{
+	rows[(int64_t)from*words + (to>>6)] |= (uint64_t)1 << (to&63);
+}
+
+bool clique_graph::has(int from, int to) const
+{
+	return (rows[(int64_t)from*words + (to>>6)] >> (to&63)) & 1;
+}
+
+const uint64_t *clique_graph::row(int v) const
+{
+	return rows.data() + (int64_t)v*words;
+}
+
+bool clique_graph::symmetric() const
+{
+	for (int i = 0; i < vertices; i++)
+		for (int j = i+1; j < vertices; j++)
+			if (has(i, j) != has(j, i))
+				return false;
+	return true;
+}
+
+namespace
+{
+
+struct clique_frame
+{
+	vector<int> R;
+	vector<uint64_t> P, X;
+};
+
+bool is_empty(const vector<uint64_t> &s)
+{
+	for (auto w = s.begin(); w != s.end(); w++)
+		if (*w != 0)
+			return false;
+	return true;
+}
+
+// Appends the frames for the candidates of curr to children in the order
+// they are pushed on the stack, so they are searched from the back.
+void branch(const clique_graph &g, bool pivot, clique_frame &curr, vector<clique_frame> &children)
+{
+	int words = g.words;
+
+	// Any maximal clique must hold the pivot or one of the candidates that
+	// aren't its neighbors, so only those need to be tried.
+	vector<uint64_t> candidates = curr.P;
+	if (pivot)
+	{
+		int best = -1, most = -1;
+		for (int w = 0; w < words; w++)
+		{
+			for (uint64_t bits = curr.P[w] | curr.X[w]; bits != 0; bits &= bits-1)
+			{
+				int u = w*64 + std::countr_zero(bits);
+				const uint64_t *n = g.row(u);
+				int count = 0;
+				for (int k = 0; k < words; k++)
+					count += std::popcount(curr.P[k] & n[k]);
+				if (count > most)
+				{
+					best = u;
+					most = count;
+				}
+			}
+		}
+		const uint64_t *n = g.row(best);
+		for (int w = 0; w < words; w++)
+			candidates[w] &= ~n[w];
+	}
+
+	// Take the candidates from the back so that, without a pivot, the
+	// cliques come out in the order described in clique.h
+	for (int w = words-1; w >= 0; w--)
+	{
+		while (candidates[w] != 0)
+		{
+			int b = 63 - std::countl_zero(candidates[w]);
+			candidates[w] &= ~((uint64_t)1 << b);
+			int v = w*64 + b;
+
+			const uint64_t *n = g.row(v);
+			children.push_back(clique_frame());
+			children.back().R = curr.R;
+			children.back().R.push_back(v);
+			children.back().P.resize(words);
+			children.back().X.resize(words);
+			for (int k = 0; k < words; k++)
+			{
+				children.back().P[k] = curr.P[k] & n[k];
+				children.back().X[k] = curr.X[k] & n[k];
+			}
+
+			curr.P[w] &= ~((uint64_t)1 << b);
+			curr.X[w] |= (uint64_t)1 << b;
+		}
+	}
+}
+
+int count_of(const vector<uint64_t> &s)
+{
+	int result = 0;
+	for (auto w = s.begin(); w != s.end(); w++)
+		result += std::popcount(*w);
+	return result;
+}
+
+// Runs Bron–Kerbosch from root, calling visit with each maximal clique.
+// Returns false if visit or the limits stopped the search.
+bool search(const clique_graph &g, bool pivot, clique_frame root, const function<bool(const vector<int>&)> &visit, const clique_limits &limits)
+{
+	auto start = std::chrono::steady_clock::now();
+	int64_t visited = 0;
+	int64_t steps = 0;
+
+	vector<clique_frame> frames;
+	frames.push_back(std::move(root));
+	while (not frames.empty())
+	{
+		clique_frame curr = std::move(frames.back());
+		frames.pop_back();
+
+		// The clock is only read every so often
+		if (limits.seconds > 0 and (++steps & 1023) == 0
+			and std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= limits.seconds)
+			return false;
+
+		if (is_empty(curr.P))
+		{
+			// Then we've found a maximal clique
+			if (is_empty(curr.X) and (int)curr.R.size() >= limits.min_size)
+			{
+				sort(curr.R.begin(), curr.R.end());
+				if (not visit(curr.R) or (limits.count > 0 and ++visited >= limits.count))
+					return false;
+			}
+		}
+		else if ((limits.max_size <= 0 or (int)curr.R.size() < limits.max_size)
+			and (limits.min_size <= 0 or (int)curr.R.size() + count_of(curr.P) >= limits.min_size))
+			branch(g, pivot, curr, frames);
+	}
+	return true;
+}
+
+// Runs Bron–Kerbosch from root, appending the maximal cliques to result
+void search(const clique_graph &g, bool pivot, clique_frame root, vector<vector<int> > &result)
+{
+	search(g, pivot, std::move(root), [&result](const vector<int> &clique) {
+		result.push_back(clique);
+		return true;
+	}, clique_limits());
+}
+
+clique_frame root_of(const clique_graph &g)
+{
+	clique_frame root;
+	root.P.assign(g.words, 0);
+	root.X.assign(g.words, 0);
+	for (int v = 0; v < g.vertices; v++)
+		root.P[v>>6] |= (uint64_t)1 << (v&63);
+	return root;
+}
+
+}
+
+clique_limits::clique_limits()
+{
+	count = 0;
+	min_size = 0;
+	max_size = 0;
+	seconds = 0.0;
+}
+
+clique_limits::~clique_limits()
+{
+}
+
+vector<vector<int> > maximal_cliques(const clique_graph &g, thread_pool *pool)
+{
+	bool pivot = g.symmetric();
+	clique_frame root = root_of(g);
+
+	vector<vector<int> > result;
+	if (pool == nullptr or pool->size() <= 1)
+		search(g, pivot, std::move(root), result);
+	else
+	{
+		// Split the search into independent frames in the order the serial
+		// search would visit them, and then search each of them on the
+		// thread pool. The threads take the frames as they free up, and the
+		// cliques of each frame are kept apart so they can be put back
+		// together in order.
+		vector<clique_frame> frames;
+		frames.push_back(std::move(root));
+		bool grew = true;
+		while (grew and (int)frames.size() < 8*pool->size())
+		{
+			grew = false;
+			vector<clique_frame> next, children;
+			for (auto f = frames.begin(); f != frames.end(); f++)
+			{
+				if (is_empty(f->P))
+					next.push_back(std::move(*f));
+				else
+				{
+					children.clear();
+					branch(g, pivot, *f, children);
+					for (auto c = children.rbegin(); c != children.rend(); c++)
+						next.push_back(std::move(*c));
+					grew = true;
+				}
+			}
+			frames = std::move(next);
+		}
+
+		vector<vector<vector<int> > > found(frames.size());
+		pool->run((int)frames.size(), [&g, pivot, &frames, &found](int thread, int i) {
+			search(g, pivot, std::move(frames[i]), found[i]);
+		});
+		for (auto f = found.begin(); f != found.end(); f++)
+			for (auto c = f->begin(); c != f->end(); c++)
+				result.push_back(std::move(*c));
+	}
+
+	if (pivot)
+	{
+		sort(result.begin(), result.end(), [](const vector<int> &a, const vector<int> &b) {
+			return lexicographical_compare(a.rbegin(), a.rend(), b.rbegin(), b.rend());
+		});
+	}
+	return result;
+}
+
+bool maximal_cliques(const clique_graph &g, const function<bool(const vector<int>&)> &visit, clique_limits limits)
+{
+	return search(g, g.symmetric(), root_of(g), visit, limits);
+}
+
+clique_set::clique_set(int shards) : shards(shards)
+{
+}
+
+clique_set::~clique_set()
+{
+}
+
+size_t clique_set::hasher::operator()(const vector<uint64_t> &clique) const
+{
+	// FNV-1a over the words
+	uint64_t result = 14695981039346656037ull;
+	for (auto w = clique.begin(); w != clique.end(); w++)
+	{
+		result ^= *w;
+		result *= 1099511628211ull;
+	}
+	return (size_t)(result ^ (result >> 32));
+}
+
+bool clique_set::insert(const vector<uint64_t> &clique)
+{
+	shard &s = shards[hasher()(clique) % shards.size()];
+	std::lock_guard<std::mutex> guard(s.lock);
+	return s.cliques.insert(clique).second;
+}
+
+int64_t clique_set::size() const
+{
+	int64_t result = 0;
+	for (auto s = shards.begin(); s != shards.end(); s++)
+		result += (int64_t)s->cliques.size();
+	return result;
+}
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <common/standard.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+#include "parallel.h"
+
+namespace petri
+{
+
+// The edges of the implicit graph searched by graph::select() and
+// graph::group(), one bitset row per vertex. Bit c of row v is set if vertex
+// c stays a candidate once vertex v is added to a clique. The relations
+// behind these edges are usually symmetric, but nothing here requires it.
+struct clique_graph
+{
+	clique_graph();
+	clique_graph(int vertices);
+	~clique_graph();
+
+	int vertices;
+	int words;
+	vector<uint64_t> rows;
+
+	void connect(int from, int to);
+	bool has(int from, int to) const;
+	const uint64_t *row(int v) const;
+
+	// Whether every edge goes both ways
+	bool symmetric() const;
+};
+
+// Find every maximal clique of g as a sorted list of vertices. If g is
+// symmetric, this runs Bron–Kerbosch with the Tomita pivot and then sorts
+// the cliques into the order that Bron–Kerbosch without a pivot finds them
+// when it takes the candidates from the back: by their vertices from last
+// to first, compared lexicographically. Otherwise, it runs Bron–Kerbosch
+// without a pivot. Given a pool, the search is split into independent
+// frames that are spread over its threads, and the result is the same as
+// the serial one.
+vector<vector<int> > maximal_cliques(const clique_graph &g, thread_pool *pool = nullptr);
+
+// Bounds on a streaming clique search, where zero means no bound. Only the
+// maximal cliques with at least min_size and at most max_size vertices are
+// visited, and the parts of the search that can only find other cliques are
+// skipped. The search stops after it has visited count cliques or after it
+// has run for seconds.
+struct clique_limits
+{
+	clique_limits();
+	~clique_limits();
+
+	int64_t count;
+	int min_size;
+	int max_size;
+	double seconds;
+};
+
+// Call visit with every maximal clique of g, as a sorted list of vertices,
+// as soon as it is found. The search runs on the calling thread, and cliques
+// are visited in the order they are found, which is only the order of
+// maximal_cliques() if g isn't symmetric. The search stops as soon as visit
+// returns false or a limit is reached. Returns true if the search ran to
+// the end.
+bool maximal_cliques(const clique_graph &g, const function<bool(const vector<int>&)> &visit, clique_limits limits = clique_limits());
+
+// A set of cliques, each stored as a bitset of its vertices, that many
+// threads can add to at once. The cliques are spread over shards by their
+// hash, and each shard has its own lock.
+struct clique_set
+{
+	clique_set(int shards = 64);
+	~clique_set();
+
+	struct hasher
+	{
+		size_t operator()(const vector<uint64_t> &clique) const;
+	};
+
+	struct shard
+	{
+		std::mutex lock;
+		unordered_set<vector<uint64_t>, hasher> cliques;
+	};
+
+	vector<shard> shards;
+
+	// Returns true if clique was not in the set yet
+	bool insert(const vector<uint64_t> &clique);
+	int64_t size() const;
+};
+
+}
@@ -0,0 +1,270 @@
+#include "distance.h"
+
+namespace petri
+{
+
+distance_matrix::distance_matrix()
+{
+	nodes = 0;
+	width = 4;
+	oldest = -1;
+	newest = -1;
+	used = 0;
+}
+
+distance_matrix::~distance_matrix()
+{
+}
+
+void distance_matrix::reset(int64_t n, int width)
+{
+	if (width != 2 and width != 4)
+		width = (n-1 <= (int64_t)std::numeric_limits<int16_t>::max() ? 2 : 4);
+	else if (width == 2 and n-1 > (int64_t)std::numeric_limits<int16_t>::max())
+		width = 4;
+
+	this->nodes = n;
+	this->width = width;
+	rows.clear();
+	rows.resize(n);
+	for (auto r = rows.begin(); r != rows.end(); r++)
+	{
+		r->ready = false;
+		r->older = -1;
+		r->newer = -1;
+	}
+	oldest = -1;
+	newest = -1;
+	used = 0;
+}
+
+bool distance_matrix::has_row(int64_t r) const
+{
+	return r >= 0 and r < nodes and rows[r].ready;
+}
+
+int distance_matrix::get(int64_t r, int64_t c) const
+{
+	if (r == c)
+		return 0;
+	if (r < 0 or r >= nodes or c < 0 or c >= nodes)
+		return unreachable;
+
+	const row &curr = rows[r];
+	if (not curr.ready)
+		return unreachable;
+
+	int tile = curr.tiles[c/tile_size];
+	if (tile < 0)
+		return unreachable;
+
+	int64_t i = (int64_t)tile*tile_size + c%tile_size;
+	if (width == 2)
+	{
+		int16_t value = curr.data16[i];
+		return value == std::numeric_limits<int16_t>::min() ? unreachable : (int)value;
+	}
+	return curr.data32[i];
+}
+
+void distance_matrix::store_row(int64_t r, const vector<int> &values)
+{
+	row &curr = rows[r];
+	int64_t count = (nodes + tile_size - 1)/tile_size;
+	curr.tiles.assign(count, -1);
+	curr.data16.clear();
+	curr.data32.clear();
+
+	int used = 0;
+	for (int64_t t = 0; t < count; t++)
+	{
+		int64_t first = t*tile_size;
+		int64_t last = min(nodes, first + tile_size);
+		bool reachable = false;
+		for (int64_t c = first; c < last and not reachable; c++)
+			reachable = (values[c] != unreachable and c != r);
+		if (reachable)
+			curr.tiles[t] = used++;
+	}
+
+	if (width == 2)
+		curr.data16.assign(used*tile_size, std::numeric_limits<int16_t>::min());
+	else
+		curr.data32.assign(used*tile_size, unreachable);
+
+	for (int64_t t = 0; t < count; t++)
+	{
+		if (curr.tiles[t] < 0)
+			continue;
+
+		int64_t first = t*tile_size;
+		int64_t last = min(nodes, first + tile_size);
+		int64_t offset = (int64_t)curr.tiles[t]*tile_size - first;
+		if (width == 2)
+			for (int64_t c = first; c < last; c++)
+				curr.data16[offset + c] = (values[c] == unreachable ? std::numeric_limits<int16_t>::min() : (int16_t)values[c]);
+		else
+			for (int64_t c = first; c < last; c++)
+				curr.data32[offset + c] = values[c];
+	}
+
+	curr.ready = true;
+}
+
+void distance_matrix::load_row(int64_t r, vector<int> &values) const
+{
+	values.assign(nodes, unreachable);
+	if (not has_row(r))
+		return;
+
+	const row &curr = rows[r];
+	for (int64_t t = 0; t < (int64_t)curr.tiles.size(); t++)
+	{
+		if (curr.tiles[t] < 0)
+			continue;
+
+		int64_t first = t*tile_size;
+		int64_t last = min(nodes, first + tile_size);
+		int64_t offset = (int64_t)curr.tiles[t]*tile_size - first;
+		if (width == 2)
+			for (int64_t c = first; c < last; c++)
+				values[c] = (curr.data16[offset + c] == std::numeric_limits<int16_t>::min() ? unreachable : (int)curr.data16[offset + c]);
+		else
+			for (int64_t c = first; c < last; c++)
+				values[c] = curr.data32[offset + c];
+	}
+	values[r] = 0;
+}
+
+vector<int> distance_matrix::load_row(int64_t r) const
+{
+	vector<int> result;
+	load_row(r, result);
+	return result;
+}
+
+void distance_matrix::drop_row(int64_t r)
+{
+	row &curr = rows[r];
+	if (listed(r))
+		unlink(r);
+	curr.ready = false;
+	vector<int>().swap(curr.tiles);
+	vector<int16_t>().swap(curr.data16);
+	vector<int32_t>().swap(curr.data32);
+}
+
+void distance_matrix::set(int64_t r, int64_t c, int value)
+{
+	if (r < 0 or r >= nodes or c < 0 or c >= nodes or r == c)
+		return;
+
+	if (width == 2 and value != unreachable
+		and (value <= (int)std::numeric_limits<int16_t>::min() or value > (int)std::numeric_limits<int16_t>::max()))
+	{
+		distance_matrix wide;
+		wide.reset(nodes, 4);
+		vector<int> values;
+		for (int64_t i = 0; i < nodes; i++)
+		{
+			if (has_row(i))
+			{
+				load_row(i, values);
+				wide.store_row(i, values);
+			}
+		}
+		for (int64_t i = oldest; i >= 0; i = rows[i].newer)
+			wide.touch(i);
+		std::swap(*this, wide);
+	}
+
+	vector<int> values;
+	load_row(r, values);
+	values[c] = value;
+	store_row(r, values);
+}
+
+void distance_matrix::touch(int64_t r)
+{
+	if (not has_row(r) or r == newest)
+		return;
+	if (listed(r))
+		unlink(r);
+	link(r);
+}
+
+int64_t distance_matrix::resident() const
+{
+	return used;
+}
+
+int64_t distance_matrix::least_recently_used() const
+{
+	return oldest;
+}
+
+bool distance_matrix::listed(int64_t r) const
+{
+	return r == oldest or rows[r].older >= 0;
+}
+
+// Add row r to the newest end of the list of used rows
+void distance_matrix::link(int64_t r)
+{
+	rows[r].older = newest;
+	rows[r].newer = -1;
+	if (newest >= 0)
+		rows[newest].newer = r;
+	else
+		oldest = r;
+	newest = r;
+	used++;
+}
+
+void distance_matrix::unlink(int64_t r)
+{
+	if (rows[r].older >= 0)
+		rows[rows[r].older].newer = rows[r].newer;
+	else
+		oldest = rows[r].newer;
+	if (rows[r].newer >= 0)
+		rows[rows[r].newer].older = rows[r].older;
+	else
+		newest = rows[r].older;
+	rows[r].older = -1;
+	rows[r].newer = -1;
+	used--;
+}
+
+int64_t distance_matrix::memory() const
+{
+	int64_t result = 0;
+	for (auto r = rows.begin(); r != rows.end(); r++)
+		result += (int64_t)(r->tiles.capacity()*sizeof(int) + r->data16.capacity()*sizeof(int16_t) + r->data32.capacity()*sizeof(int32_t));
+	return result;
+}
+
+bool operator==(const distance_matrix &m0, const distance_matrix &m1)
+{
+	if (m0.nodes != m1.nodes)
+		return false;
+
+	vector<int> r0, r1;
+	for (int64_t r = 0; r < m0.nodes; r++)
+	{
+		if (m0.has_row(r) != m1.has_row(r))
+			return false;
+		m0.load_row(r, r0);
+		m1.load_row(r, r1);
+		if (r0 != r1)
+			return false;
+	}
+	return true;
+}
+
+bool operator!=(const distance_matrix &m0, const distance_matrix &m1)
+{
+	return !(m0 == m1);
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <common/standard.h>
+
+#include <cstdint>
+#include <limits>
+
+namespace petri
+{
+
+// Storage for the node distance matrix of a graph. Row r holds the distance
+// from every node to node r, and rows are stored independently so they can
+// be computed on demand and from several threads at once. Each row is split
+// into tiles of tile_size columns and a tile is only allocated once it holds
+// a reachable node, so a row only pays for the part of the net that reaches
+// its node. Entries are 16 bits wide when every distance fits, and 32 bits
+// otherwise. All of the indexing is 64-bit.
+struct distance_matrix
+{
+	distance_matrix();
+	~distance_matrix();
+
+	static constexpr int unreachable = std::numeric_limits<int>::min();
+	static constexpr int64_t tile_size = 1024;
+
+	struct row
+	{
+		// The offset of each tile in the data, in tiles, or -1 if every
+		// column in the tile is unreachable.
+		vector<int> tiles;
+		// Only the one matching the element width is used
+		vector<int16_t> data16;
+		vector<int32_t> data32;
+		bool ready;
+		// The neighbors of the row in the list of used rows, or -1
+		int64_t older;
+		int64_t newer;
+	};
+
+	int64_t nodes;
+	int width;
+	vector<row> rows;
+
+	// The stored rows that were passed to touch(), from the one used the
+	// longest time ago to the one used last, as a list threaded through the
+	// rows, and their number. Rows may be stored from several threads at
+	// once, so only touch() and drop_row() change the list.
+	int64_t oldest;
+	int64_t newest;
+	int64_t used;
+
+	// Clear the matrix to n nodes with no rows. width is the size of an
+	// element in bytes, 2 or 4, or 0 to use the smallest one that fits every
+	// possible distance. A distance is at most n-1.
+	void reset(int64_t n, int width = 0);
+
+	bool has_row(int64_t r) const;
+	int get(int64_t r, int64_t c) const;
+
+	// Replace row r with values, which must hold one entry per node.
+	void store_row(int64_t r, const vector<int> &values);
+	// Fill values with row r, or with unreachable entries if it was dropped.
+	void load_row(int64_t r, vector<int> &values) const;
+	vector<int> load_row(int64_t r) const;
+	void drop_row(int64_t r);
+	// Mark stored row r as the one used last, adding it to the list.
+	void touch(int64_t r);
+	// Overwrite column c of row r, which is stored first if it wasn't. The
+	// elements are widened to 32 bits if value doesn't fit in 16.
+	void set(int64_t r, int64_t c, int value);
+
+	// The number of rows in the list of used rows and the one that was used
+	// the longest time ago, or -1 if there are none. Both take constant time.
+	int64_t resident() const;
+	int64_t least_recently_used() const;
+
+	bool listed(int64_t r) const;
+	void link(int64_t r);
+	void unlink(int64_t r);
+
+	// The number of bytes held by the rows
+	int64_t memory() const;
+};
+
+bool operator==(const distance_matrix &m0, const distance_matrix &m1);
+bool operator!=(const distance_matrix &m0, const distance_matrix &m1);
+
+}
@@ -57,5 +57,49 @@ bool operator!=(arc a0, arc a1)
 	return a0.from != a1.from || a0.to != a1.to;
 }
 
+remapping::remapping()
+{
+
+}
+
+remapping::~remapping()
+{
+
+}
+
+bool remapping::erased(iterator i) const
+{
+	return i.index >= 0 && i.index < (int)index[i.type].size() && index[i.type][i.index] < 0;
+}
+
+// Nodes that did not exist when the remapping was made keep their index.
+iterator remapping::map(iterator i) const
+{
+	if (i.index >= 0 && i.index < (int)index[i.type].size())
+		i.index = index[i.type][i.index];
+	return i;
+}
+
+void remapping::apply(vector<iterator> &iter_list) const
+{
+	int k = 0;
+	for (int i = 0; i < (int)iter_list.size(); i++)
+		if (!erased(iter_list[i]))
+			iter_list[k++] = map(iter_list[i]);
+	iter_list.resize(k);
+}
+
+void remapping::apply(int type, vector<int> &iter_list) const
+{
+	int k = 0;
+	for (int i = 0; i < (int)iter_list.size(); i++)
+	{
+		iterator j = map(iterator(type, iter_list[i]));
+		if (j.index >= 0)
+			iter_list[k++] = j.index;
+	}
+	iter_list.resize(k);
+}
+
 }
 
@@ -5,9 +5,16 @@
 #include <common/text.h>
 
 #include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <unordered_map>
 #include "state.h"
 #include "iterator.h"
 #include "node.h"
+#include "parallel.h"
+#include "distance.h"
+#include "clique.h"
 
 namespace petri
 {
@@ -37,6 +44,24 @@ bool operator>=(arc a0, arc a1);
 bool operator==(arc a0, arc a1);
 bool operator!=(arc a0, arc a1);
 
+// A remapping records where every node ended up after several nodes were
+// erased in a single pass. index[type][i] is the new index of node (type, i),
+// or -1 if that node was erased. Callers use it to fix up their own lists of
+// iterators in one linear pass instead of calling graph::erase() once for
+// every erased node.
+struct remapping
+{
+	remapping();
+	~remapping();
+
+	array<vector<int>, 2> index;
+
+	bool erased(petri::iterator i) const;
+	petri::iterator map(petri::iterator i) const;
+	void apply(vector<petri::iterator> &iter_list) const;
+	void apply(int type, vector<int> &iter_list) const;
+};
+
 // Generic petri net graph representation.
 // A comprehensive implementation of Petri nets for modeling concurrent and distributed systems
 // 
@@ -57,12 +82,129 @@ bool operator!=(arc a0, arc a1);
 template <class place, class transition, class token, class state>
 struct graph
 {
-	mutable vector<int> node_distances;
+	mutable distance_matrix node_distances;
 	mutable bool node_distances_ready;
 
+	// How the distance matrix is stored, see set_distance_storage().
+	bool lazy_distances;
+	int distance_width;
+	int64_t distance_row_limit;
+
+	// Local edits to a complete distance matrix, see update_touched_distances().
+	// When node_distances_stale is set, the matrix was complete for a graph
+	// with distance_size places and transitions, and only the rows that reach
+	// a node in distance_touched are out of date.
+	mutable bool node_distances_stale;
+	mutable vector<petri::iterator> distance_touched;
+	mutable array<int, 2> distance_size;
+
+	// The number of local_edit scopes that are currently open.
+	mutable int local_edit_depth;
+
+	// Reachability closure, see update_reachability(). Nodes are numbered
+	// like the columns of node_distances. reachability_component maps each
+	// node to its strongly connected component and reachability holds, for
+	// each component, a bitset of the nodes reachable from it packed into
+	// reachability_words 64-bit words.
+	mutable vector<uint64_t> reachability;
+	mutable vector<int> reachability_component;
+	mutable int reachability_words;
+	mutable bool reachability_ready;
+
 	mutable bool split_groups_ready;
 	mutable bool merge_groups_ready[2];
 
+	// Local edits to complete split groups, see update_split_groups(). When
+	// split_groups_stale is set, the groups were complete before the edits
+	// that touched the nodes in split_touched. covered_groups[type][i] keeps
+	// the groups of the covered conditional splits that were removed from
+	// node (type, i), which are needed again to decide whether a split is
+	// covered. split_degrees[type][i] holds the number of arcs that left and
+	// entered node (type, i) when the groups were last complete.
+	mutable bool split_groups_stale;
+	mutable vector<petri::iterator> split_touched;
+	mutable array<vector<vector<split_group> >, 2> covered_groups;
+	mutable array<vector<pair<int, int> >, 2> split_degrees;
+	mutable vector<split_group> reset_groups;
+
+	// The split groups of every node indexed by composition into pools of
+	// distinct lists, see update_split_pools(). The groups stay in the nodes,
+	// and the pools are rebuilt from them by the first query after they
+	// change. Code that edits the groups in the nodes directly must clear
+	// split_pools_ready.
+	mutable array<split_pool, 2> split_pools;
+	mutable bool split_pools_ready;
+
+	// Results of compare_split_groups() in a direct-mapped table, see
+	// set_compare_memo(). Each slot holds the key of the query, made from the
+	// composition, the operations and the pool ids of both nodes, with the
+	// result in the top bit, or ~0 if it is empty.
+	bool compare_memo;
+	mutable vector<uint64_t> compare_results;
+
+	// How many of the comparisons in compare_split_groups() were answered by
+	// the signatures of the pools alone, see set_signature_stats(). They are
+	// only counted while signature_stats is set.
+	bool signature_stats;
+	mutable int64_t signature_queries;
+	mutable int64_t signature_hits;
+
+	// Relation cache, see set_relation_cache(). Nodes with the same split
+	// groups are related in the same way, so they share a class in
+	// relation_class, which is numbered like the columns of node_distances.
+	// relations[r] holds a bit-matrix over the classes for each base
+	// relation, packed into relation_words 64-bit words per row.
+	// relation_budget caps the memory of those matrices in bytes.
+	bool relation_cache;
+	int64_t relation_budget;
+	mutable array<vector<uint64_t>, 5> relations;
+	mutable vector<int> relation_class;
+	mutable int relation_words;
+	mutable bool relations_ready;
+	mutable bool relations_too_large;
+
+	// Parallel neighborhoods, see set_parallel_neighbors(). Nodes are
+	// numbered like the columns of node_distances, and each node has a
+	// bitset of neighbor_words 64-bit words over all nodes. Bit j of row i
+	// of parallel_to is set if is(parallel, i, j), and bit i of row j of
+	// parallel_from is the same bit transposed. parallel_live holds the
+	// nodes that weren't erased. These are recomputed after the pools are
+	// next packed, or if the number of nodes changed.
+	bool parallel_neighbors;
+	int64_t neighbor_budget;
+	mutable vector<uint64_t> parallel_to, parallel_from, parallel_live;
+	mutable int neighbor_words;
+	mutable array<int, 2> neighbor_size;
+	mutable bool neighbors_ready;
+	mutable bool neighbors_too_large;
+
+	// Adjacency lists of the arcs, index by node type. out_arcs[type][i]
+	// lists the indices of the arcs in arcs[type] that leave node (type, i)
+	// and in_arcs[type][i] lists the indices of the arcs in arcs[1-type] that
+	// enter it, both sorted in arc order. Every edit in this class keeps
+	// these lists up to date, so queries never need to rebuild them. Code
+	// that edits arcs directly must call mark_modified() or reset_adjacency()
+	// before the next query. adjacency_arcs counts the arcs in each list as a
+	// sanity check.
+	mutable array<vector<vector<int> >, 2> out_arcs, in_arcs;
+	mutable array<int, 2> adjacency_arcs;
+	mutable bool adjacency_ready;
+
+	// Stable handle mode, see set_stable_handles(). tombstones[type][i] is
+	// set once node (type, i) was erased in this mode, and generations[type][i]
+	// is the generation of the node in that slot. Both are index by node type
+	// and only grow as far as the last slot that was erased, slots past the
+	// end are live and have the current epoch as their generation.
+	bool stable_handles;
+	array<vector<bool>, 2> tombstones;
+	array<vector<int>, 2> generations;
+	int epoch;
+
+	// The worker threads for the whole-graph passes, see set_threads(). Copies
+	// of a graph share the same pool. Without a pool, everything runs on the
+	// calling thread.
+	shared_ptr<thread_pool> pool;
+
 	vector<place> places;
 	vector<transition> transitions;
 	// index by from.type
@@ -72,11 +214,42 @@ struct graph
 
 	graph()
 	{
+		lazy_distances = false;
+		distance_width = 0;
+		distance_row_limit = 0;
 		reset_node_distances();
+		node_distances_stale = false;
+		distance_size[0] = 0;
+		distance_size[1] = 0;
+		local_edit_depth = 0;
+		reachability_words = 0;
+		reachability_ready = false;
 		split_groups_ready = false;
-		split_groups_ready = false;
+		split_groups_stale = false;
+		split_pools_ready = false;
+		compare_memo = false;
+		signature_stats = false;
+		signature_queries = 0;
+		signature_hits = 0;
+		relation_cache = false;
+		relation_budget = 64 << 20;
+		relation_words = 0;
+		relations_ready = false;
+		relations_too_large = false;
+		parallel_neighbors = false;
+		neighbor_budget = 64 << 20;
+		neighbor_words = 0;
+		neighbor_size[0] = 0;
+		neighbor_size[1] = 0;
+		neighbors_ready = false;
+		neighbors_too_large = false;
 		merge_groups_ready[0] = false;
 		merge_groups_ready[1] = false;
+		adjacency_ready = false;
+		adjacency_arcs[0] = 0;
+		adjacency_arcs[1] = 0;
+		stable_handles = false;
+		epoch = 0;
 	}
 
 	virtual ~graph()
@@ -84,6 +257,33 @@ struct graph
 
 	}
 
+	// Run the whole-graph passes, like update_node_distances(), over the
+	// given number of threads. threads <= 0 uses one per hardware core and
+	// threads == 1 runs them serially on the calling thread. The results do
+	// not depend on the number of threads.
+	void set_threads(int threads) {
+		if (threads == 1) {
+			pool.reset();
+		} else {
+			pool = make_shared<thread_pool>(threads);
+		}
+	}
+
+	int threads() const {
+		return pool ? pool->size() : 1;
+	}
+
+	// Call job(thread, i) for every i in [0, count) on the thread pool.
+	void parallel_for(int count, const function<void(int, int)> &job) const {
+		if (pool) {
+			pool->run(count, job);
+		} else {
+			for (int i = 0; i < count; i++) {
+				job(0, i);
+			}
+		}
+	}
+
 	// Calculate the minimum number of arcs between any two nodes. This data
 	// can be used to determine if one node is reachable from another or as
 	// a way to guide logic minimization heuristics based on what is the
@@ -108,18 +308,28 @@ struct graph
 	//                ...           |                |                    |
 	//                (p+t-1)*(p+t) |                |                    |
 	//    __________________________|________________|____________________|
+	//
+	// The rows are kept in a distance_matrix, which only stores the tiles of
+	// each row that hold a reachable node and uses 16 bit entries when the
+	// net is small enough.
 	virtual void reset_node_distances() const {
-		int nodes = (int)(places.size() + transitions.size());
-		int offset = (int)places.size();
-		node_distances.clear();
-		node_distances.assign(nodes*nodes, std::numeric_limits<int>::min());
-		for (int i = 0; i < (int)places.size(); i++) {
-			node_distances[i*nodes + i] = 0;
-		}
-		for (int i = 0; i < (int)transitions.size(); i++) {
-			node_distances[(offset + i)*nodes + (offset + i)] = 0;
-		}
+		node_distances.reset((int64_t)places.size() + (int64_t)transitions.size(), distance_width);
 		node_distances_ready = false;
+		node_distances_stale = false;
+	}
+
+	// Choose how the distance matrix is stored. With lazy set, distance()
+	// only computes the row of the node it is asked about, the first time it
+	// is asked, instead of the whole matrix. At most row_limit of those rows
+	// stay resident, the least recently used row is dropped to make room for
+	// a new one. A row_limit of 0 keeps every row. width is the size of an
+	// entry in bytes, 2 or 4, or 0 to pick the smallest that fits the net.
+	// These take effect on the next computation.
+	void set_distance_storage(bool lazy, int width = 0, int64_t row_limit = 0) {
+		lazy_distances = lazy;
+		distance_width = width;
+		distance_row_limit = row_limit;
+		reset_node_distances();
 	}
 
 	// Updates the node distance matrix for a specific node position
@@ -128,37 +338,77 @@ struct graph
 	// Maintains the cached distance data in node_distances
 	// Used in reachability analysis and path calculations
 	virtual void update_node_distances(petri::iterator pos) const {
-		set<petri::iterator> seen;
+		traversal scratch;
+		update_node_distances(pos, scratch);
+	}
 
-		array<vector<vector<petri::iterator> >, 2> p;
-		p[place::type].resize(places.size());
-		p[transition::type].resize(transitions.size());
-		for (int type = 0; type < 2; type++) {
-			for (int i = 0; i < (int)arcs[type].size(); i++) {
-				p[1-type][arcs[type][i].to.index].push_back(arcs[type][i].from);
-			}
+	// Scratch space for the distance traversals, reused from one source to
+	// the next. Node i was visited by the current traversal if
+	// seen[i] == epoch, so the marks never need to be cleared. The row is
+	// built up in row and handed to node_distances once it is done, then
+	// the entries that were visited are cleared again.
+	struct traversal {
+		traversal() {
+			epoch = 0;
 		}
 
-		int nodes = (int)(places.size() + transitions.size());
-		int offset = (int)places.size();
-		int posIdx = offset*pos.type + pos.index;
-
+		vector<int> seen;
+		int epoch;
 		vector<petri::iterator> stack;
+		vector<int> row;
+		vector<int64_t> visited;
+	};
+
+	// Reused by the lazy row computations in distance()
+	mutable traversal distance_scratch;
+
+	// The predecessors come straight from the incoming arc lists, which are
+	// in arc order and shared by every source.
+	void update_node_distances(petri::iterator pos, traversal &scratch) const {
+		int64_t nodes = (int64_t)places.size() + (int64_t)transitions.size();
+		int64_t offset = (int64_t)places.size();
+		int64_t posIdx = offset*pos.type + pos.index;
+
+		if ((int64_t)scratch.seen.size() < nodes or scratch.epoch == std::numeric_limits<int>::max()) {
+			scratch.seen.assign(nodes, 0);
+			scratch.epoch = 0;
+		}
+		if ((int64_t)scratch.row.size() != nodes) {
+			scratch.row.assign(nodes, distance_matrix::unreachable);
+		}
+		int epoch = ++scratch.epoch;
+
+		vector<int> &row = scratch.row;
+		row[posIdx] = 0;
+		scratch.visited.clear();
+		scratch.visited.push_back(posIdx);
+
+		vector<petri::iterator> &stack = scratch.stack;
+		stack.clear();
 		stack.push_back(pos);
-		seen.insert(pos);
+		scratch.seen[posIdx] = epoch;
 		while (not stack.empty()) {
 			petri::iterator curr = stack.back();
 			stack.pop_back();
 
-			int toIdx = offset*curr.type + curr.index;
-			for (auto i = p[curr.type][curr.index].begin(); i != p[curr.type][curr.index].end(); i++) {
-				int fromIdx = offset*i->type + i->index;
-				if (seen.insert(*i).second) {
-					node_distances[posIdx*nodes + fromIdx] = max(node_distances[posIdx*nodes + fromIdx], node_distances[posIdx*nodes + toIdx] + 1);
-					stack.push_back(*i);
+			int64_t toIdx = offset*curr.type + curr.index;
+			const vector<int> &p = incoming(curr.type, curr.index);
+			for (auto i = p.begin(); i != p.end(); i++) {
+				petri::iterator from = arcs[1-curr.type][*i].from;
+				int64_t fromIdx = offset*from.type + from.index;
+				if (scratch.seen[fromIdx] != epoch) {
+					scratch.seen[fromIdx] = epoch;
+					row[fromIdx] = max(row[fromIdx], row[toIdx] + 1);
+					scratch.visited.push_back(fromIdx);
+					stack.push_back(from);
 				}
 			}
 		}
+
+		node_distances.store_row(posIdx, row);
+		for (auto i = scratch.visited.begin(); i != scratch.visited.end(); i++) {
+			row[*i] = distance_matrix::unreachable;
+		}
 	}
 
 	// Updates the entire node distance matrix for all nodes in the Petri net
@@ -170,35 +420,220 @@ struct graph
 		// for all of the pre-set nodes. However, doing so triggers an infinite
 		// loop around loops with splits and merges
 
+		if (node_distances_stale and update_touched_distances()) {
+			return;
+		}
+
 		// clear the current set of distances
 		if (not node_distances_ready) {
 			reset_node_distances();
 		}
 
-		for (int i = 0; i < (int)places.size(); i++) {
-			update_node_distances(petri::iterator(place::type, i));
+		// Each traversal only writes the row of its own node, so the rows may
+		// be computed in any order and on any thread. The adjacency lists are
+		// brought up to date first so the threads only ever read them.
+		update_adjacency();
+		vector<traversal> scratch(threads());
+		int offset = (int)places.size();
+		parallel_for((int)(places.size() + transitions.size()), [this, offset, &scratch](int thread, int i) {
+			if (i < offset) {
+				update_node_distances(petri::iterator(place::type, i), scratch[thread]);
+			} else {
+				update_node_distances(petri::iterator(transition::type, i - offset), scratch[thread]);
+			}
+		});
+
+		node_distances_ready = true;
+		node_distances_stale = false;
+		distance_touched.clear();
+		distance_size[place::type] = (int)places.size();
+		distance_size[transition::type] = (int)transitions.size();
+	}
+
+	// Edits made while a local_edit is in scope only mark the distance matrix
+	// and the split groups stale. They must only append nodes and arcs or change the endpoints of
+	// existing arcs, and they record every node whose predecessors changed.
+	struct local_edit {
+		local_edit(const graph *g) {
+			this->g = g;
+			g->local_edit_depth++;
 		}
 
-		for (int i = 0; i < (int)transitions.size(); i++) {
-			update_node_distances(petri::iterator(transition::type, i));
+		~local_edit() {
+			g->local_edit_depth--;
+		}
+
+		const graph *g;
+	};
+
+	// Record that the predecessors of n changed during a local edit.
+	void touch_distances(petri::iterator n) const {
+		if (local_edit_depth > 0 and node_distances_stale) {
+			distance_touched.push_back(n);
+		}
+	}
+
+	// Record that the arcs of n changed during a local edit.
+	void touch_splits(petri::iterator n) const {
+		if (local_edit_depth > 0 and split_groups_stale) {
+			split_touched.push_back(n);
+		}
+	}
+
+	// Bring a stale distance matrix up to date after local edits. The
+	// traversal for row r only ever visits the nodes that reach r, so it runs
+	// exactly as before unless it visits a node whose predecessors changed.
+	// Only those rows and the rows of the new nodes are recomputed, the new
+	// columns of every other row stay unreachable. With lazy distances, those
+	// rows are dropped instead, to be recomputed when they are next used.
+	// Returns false without changing anything if the edits touch too much of
+	// the matrix, in which case the caller recomputes all of it.
+	bool update_touched_distances() const {
+		int64_t p0 = distance_size[place::type];
+		int64_t n0 = (int64_t)distance_size[place::type] + distance_size[transition::type];
+		int64_t p1 = (int64_t)places.size();
+		int64_t n1 = (int64_t)places.size() + (int64_t)transitions.size();
+		if (p1 < p0 or (int)transitions.size() < distance_size[transition::type] or node_distances.nodes != n0) {
+			return false;
+		}
+
+		// map an old index into the new matrix
+		auto remap = [p0, p1](int64_t i) {
+			return i < p0 ? i : i - p0 + p1;
+		};
+
+		vector<bool> dirty(n1, false);
+		for (int64_t i = p0; i < p1; i++) {
+			dirty[i] = true;
+		}
+		for (int64_t i = remap(n0); i < n1; i++) {
+			dirty[i] = true;
+		}
+
+		vector<bool> seen(n0, false);
+		for (auto t = distance_touched.begin(); t != distance_touched.end(); t++) {
+			if (t->index >= distance_size[t->type]) {
+				continue;
+			}
+
+			int64_t col = p0*t->type + t->index;
+			if (seen[col]) {
+				continue;
+			}
+			seen[col] = true;
+
+			for (int64_t r = 0; r < n0; r++) {
+				if (node_distances.get(r, col) >= 0 and node_distances.has_row(r)) {
+					dirty[remap(r)] = true;
+				}
+			}
+		}
+
+		// Everything below is indexed by the new rows. With lazy distances,
+		// only the dirty rows that were stored need to be dropped.
+		vector<bool> resident(n1, false);
+		for (int64_t r = 0; r < n0; r++) {
+			resident[remap(r)] = node_distances.has_row(r);
+		}
+
+		vector<int64_t> rows;
+		for (int64_t r = 0; r < n1; r++) {
+			if (dirty[r] and (not lazy_distances or resident[r])) {
+				rows.push_back(r);
+			}
+		}
+		if (not lazy_distances and 2*(int64_t)rows.size() > n1) {
+			return false;
+		}
+
+		if (n1 != n0) {
+			distance_matrix widened;
+			widened.reset(n1, distance_width);
+			vector<int> row, values(n1, distance_matrix::unreachable);
+			for (int64_t r = 0; r < n0; r++) {
+				if (node_distances.has_row(r) and not dirty[remap(r)]) {
+					node_distances.load_row(r, row);
+					for (int64_t c = 0; c < n0; c++) {
+						values[remap(c)] = row[c];
+					}
+					widened.store_row(remap(r), values);
+				}
+			}
+			// keep the order in which the rows were used
+			for (int64_t r = node_distances.least_recently_used(); r >= 0; r = node_distances.rows[r].newer) {
+				widened.touch(remap(r));
+			}
+			std::swap(node_distances, widened);
+		}
+
+		if (lazy_distances) {
+			for (auto r = rows.begin(); r != rows.end(); r++) {
+				if (node_distances.has_row(*r)) {
+					node_distances.drop_row(*r);
+				}
+			}
+		} else {
+			update_adjacency();
+			vector<traversal> scratch(threads());
+			parallel_for((int)rows.size(), [this, p1, &rows, &scratch](int thread, int i) {
+				int64_t r = rows[i];
+				if (r < p1) {
+					update_node_distances(petri::iterator(place::type, (int)r), scratch[thread]);
+				} else {
+					update_node_distances(petri::iterator(transition::type, (int)(r - p1)), scratch[thread]);
+				}
+			});
 		}
 
 		node_distances_ready = true;
+		node_distances_stale = false;
+		distance_touched.clear();
+		distance_size[place::type] = (int)p1;
+		distance_size[transition::type] = (int)transitions.size();
+		return true;
 	}
 
-	virtual int &distance(petri::iterator from, petri::iterator to, bool update = true) const {
-		if (update and not node_distances_ready) {
+	// The distance from one node to another, or a negative number if there
+	// is no path. With lazy distances, only the row of to is computed.
+	//
+	// This returns the distance by value. It used to return a reference into
+	// the matrix, and code that assigned through that reference must call
+	// set_distance() instead.
+	virtual int distance(petri::iterator from, petri::iterator to, bool update = true) const {
+		if (update and lazy_distances) {
+			if (not node_distances_ready and not (node_distances_stale and update_touched_distances())) {
+				reset_node_distances();
+				node_distances_ready = true;
+				distance_size[place::type] = (int)places.size();
+				distance_size[transition::type] = (int)transitions.size();
+			}
+
+			int64_t toIdx = (int64_t)places.size()*to.type + to.index;
+			if (to.index >= 0 and to.index < size(to.type)) {
+				if (not node_distances.has_row(toIdx)) {
+					if (distance_row_limit > 0 and node_distances.resident() >= distance_row_limit) {
+						node_distances.drop_row(node_distances.least_recently_used());
+					}
+					update_node_distances(to, distance_scratch);
+				}
+				node_distances.touch(toIdx);
+			}
+		} else if (update and not node_distances_ready) {
 			update_node_distances();
 		}
 
-		int nodes = places.size() + transitions.size();
-		int fromIdx = places.size()*from.type + from.index;
-		int toIdx = places.size()*to.type + to.index;
-		int idx = toIdx*nodes + fromIdx;
-		if (idx >= (int)node_distances.size()) {
-			node_distances.resize(nodes*nodes, std::numeric_limits<int>::min());
-		}
-		return node_distances[idx];
+		int64_t fromIdx = (int64_t)places.size()*from.type + from.index;
+		int64_t toIdx = (int64_t)places.size()*to.type + to.index;
+		return node_distances.get(toIdx, fromIdx);
+	}
+
+	// Overwrite the distance from one node to another until the distances
+	// are next recomputed.
+	virtual void set_distance(petri::iterator from, petri::iterator to, int value) {
+		distance(from, to);
+		int64_t fromIdx = (int64_t)places.size()*from.type + from.index;
+		int64_t toIdx = (int64_t)places.size()*to.type + to.index;
+		node_distances.set(toIdx, fromIdx, value);
 	}
 
 	virtual int distance(vector<petri::iterator> from, vector<petri::iterator> to) const {
@@ -211,14 +646,112 @@ struct graph
 		return result;
 	}
 
+	// Compute the reachability closure. This only answers whether there is a
+	// path from one node to another, so it fits in a bit per pair of nodes
+	// instead of the int per pair of node_distances. The strongly connected
+	// components are found with an iterative Tarjan's algorithm, which
+	// finishes each component after every component reachable from it. So
+	// the closure of a component is just its own nodes OR'ed word by word
+	// with the closures of its successors.
+	virtual void update_reachability() const {
+		if (reachability_ready) {
+			return;
+		}
+
+		int nodes = (int)(places.size() + transitions.size());
+		int offset = (int)places.size();
+		int words = (nodes+63)/64;
+		reachability_words = words;
+		reachability.clear();
+		reachability_component.assign(nodes, -1);
+
+		vector<int> order(nodes, -1), low(nodes, 0), merged;
+		vector<int> stack;
+		// the node and the position of its next outgoing arc
+		vector<pair<int, int> > call;
+		int counter = 0;
+		int components = 0;
+		for (int root = 0; root < nodes; root++) {
+			if (order[root] >= 0) {
+				continue;
+			}
+
+			order[root] = low[root] = counter++;
+			stack.push_back(root);
+			call.push_back(pair<int, int>(root, 0));
+			while (not call.empty()) {
+				int v = call.back().first;
+				int type = v < offset ? place::type : transition::type;
+				const vector<int> &o = outgoing(type, v - offset*type);
+				if (call.back().second < (int)o.size()) {
+					petri::iterator to = arcs[type][o[call.back().second++]].to;
+					int w = offset*to.type + to.index;
+					if (order[w] < 0) {
+						order[w] = low[w] = counter++;
+						stack.push_back(w);
+						call.push_back(pair<int, int>(w, 0));
+					} else if (reachability_component[w] < 0) {
+						low[v] = min(low[v], order[w]);
+					}
+					continue;
+				}
+
+				call.pop_back();
+				if (not call.empty()) {
+					low[call.back().first] = min(low[call.back().first], low[v]);
+				}
+				if (low[v] != order[v]) {
+					continue;
+				}
+
+				// v is the root of a component, pop it off the stack and
+				// merge in the closure of every component it points to.
+				int c = components++;
+				reachability.resize((size_t)components*words, 0);
+				merged.resize(components, -1);
+				uint64_t *row = reachability.data() + (size_t)c*words;
+				int first = (int)stack.size();
+				do {
+					first--;
+					reachability_component[stack[first]] = c;
+					row[stack[first]>>6] |= ((uint64_t)1) << (stack[first]&63);
+				} while (stack[first] != v);
+
+				for (int k = first; k < (int)stack.size(); k++) {
+					int u = stack[k];
+					int utype = u < offset ? place::type : transition::type;
+					const vector<int> &uo = outgoing(utype, u - offset*utype);
+					for (auto a = uo.begin(); a != uo.end(); a++) {
+						petri::iterator to = arcs[utype][*a].to;
+						int d = reachability_component[offset*to.type + to.index];
+						if (d != c and merged[d] != c) {
+							merged[d] = c;
+							const uint64_t *src = reachability.data() + (size_t)d*words;
+							for (int j = 0; j < words; j++) {
+								row[j] |= src[j];
+							}
+						}
+					}
+				}
+				stack.resize(first);
+			}
+		}
+
+		reachability_ready = true;
+	}
+
 	virtual bool is_reachable(petri::iterator from, petri::iterator to) const {
-		return (distance(from, to) >= 0);
+		update_reachability();
+		int fromIdx = (int)places.size()*from.type + from.index;
+		int toIdx = (int)places.size()*to.type + to.index;
+		const uint64_t *row = reachability.data() + (size_t)reachability_component[fromIdx]*reachability_words;
+		return (row[toIdx>>6] >> (toIdx&63)) & 1;
 	}
 
 	virtual bool is_reachable(vector<petri::iterator> from, vector<petri::iterator> to) const {
 		for (auto i = from.begin(); i != from.end(); i++) {
 			for (auto j = to.begin(); j != to.end(); j++) {
-				if (distance(*i, *j) >= 0) {
+				if (is_reachable(*i, *j)) {
 					return true;
 				}
 			}
@@ -227,15 +760,6 @@ struct graph
 	}
 
 	virtual bool precedes(petri::iterator from, petri::iterator to, set<petri::iterator> excl=set<petri::iterator>()) const {
-		array<vector<vector<petri::iterator> >, 2> n;
-		n[place::type].resize(places.size());
-		n[transition::type].resize(transitions.size());
-		for (int type = 0; type < 2; type++) {
-			for (int i = 0; i < (int)arcs[type].size(); i++) {
-				n[type][arcs[type][i].from.index].push_back(arcs[type][i].to);
-			}
-		}
-
 		set<petri::iterator> seen = excl;
 		seen.insert(from);
 
@@ -245,12 +769,14 @@ struct graph
 			petri::iterator curr = stack.back();
 			stack.pop_back();
 
-			for (auto i = n[curr.type][curr.index].begin(); i != n[curr.type][curr.index].end(); i++) {
-				if (*i == to) {
+			const vector<int> &o = outgoing(curr.type, curr.index);
+			for (auto i = o.begin(); i != o.end(); i++) {
+				petri::iterator n = arcs[curr.type][*i].to;
+				if (n == to) {
 					return true;
 				}
-				if (seen.insert(*i).second) {
-					stack.push_back(*i);
+				if (seen.insert(n).second) {
+					stack.push_back(n);
 				}
 			}
 		}
@@ -309,13 +835,13 @@ struct graph
 			return true;
 		}
 
-		vector<split_group> groups = split_groups_of(choice, p, false);
+		span<const split_group> groups = split_groups_view(choice, p, false);
 		for (auto group = groups.begin(); group != groups.end(); group++) {
 			bool found = true;
 			vector<vector<petri::iterator> > clusters;
 			clusters.resize(group->count);
 			for (auto j = n.begin(); j != n.end() and found; j++) {
-				vector<split_group> subs = split_groups_of(choice, *j, false);
+				span<const split_group> subs = split_groups_view(choice, *j, false);
 				auto pos = find(subs.begin(), subs.end(), group->split);
 				if (pos != subs.end()) {
 					for (auto i = pos->branch.begin(); i != pos->branch.end() and found; i++) {
@@ -362,28 +888,172 @@ struct graph
 	// @param split The index of the split node being analyzed
 	// @param init Vector of initial nodes representing the branches of the split
 	virtual void compute_split_group(int composition, int split, vector<petri::iterator> init) const {
-		if (init.size() <= 1) {
-			// there is no split here
-			return;
+		update_adjacency();
+		split_context ctx;
+		build_split_context(ctx);
+		split_scratch scratch;
+		vector<pair<petri::iterator, split_group> > result;
+		compute_split_group(composition, split, init, ctx, scratch, result);
+
+		// replace whatever was left from a previous run of this split
+		relations_ready = false;
+		split_pools_ready = false;
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = begin(type); i != end(type); i = next_node(i)) {
+				vector<split_group> *groups = split_groups_iter(composition, i);
+				auto pos = lower_bound(groups->begin(), groups->end(), split);
+				if (pos != groups->end() and pos->split == split) {
+					groups->erase(pos);
+				}
+			}
+		}
+		for (auto i = result.begin(); i != result.end(); i++) {
+			set_split_group(composition, i->first, i->second);
 		}
+	}
 
-		// precache previous places
+	// The predecessors and successors of every node, shared by all of the
+	// split group computations in a pass. The reset states are predecessors
+	// of their places, as transition -i-1 for reset state i.
+	struct split_context {
 		array<vector<vector<petri::iterator> >, 2> p, n;
-		p[place::type].resize(places.size());
-		p[transition::type].resize(transitions.size());
-		n[place::type].resize(places.size());
-		n[transition::type].resize(transitions.size());
+	};
+
+	void build_split_context(split_context &ctx) const {
 		for (int type = 0; type < 2; type++) {
-			for (int i = 0; i < (int)arcs[type].size(); i++) {
-				n[type][arcs[type][i].from.index].push_back(arcs[type][i].to);
-				p[1-type][arcs[type][i].to.index].push_back(arcs[type][i].from);
+			ctx.p[type].assign(size(type), vector<petri::iterator>());
+			ctx.n[type].assign(size(type), vector<petri::iterator>());
+			for (int i = 0; i < size(type); i++) {
+				const vector<int> &o = outgoing(type, i);
+				for (auto j = o.begin(); j != o.end(); j++) {
+					ctx.n[type][i].push_back(arcs[type][*j].to);
+				}
+				const vector<int> &a = incoming(type, i);
+				for (auto j = a.begin(); j != a.end(); j++) {
+					ctx.p[type][i].push_back(arcs[1-type][*j].from);
+				}
 			}
 		}
 		for (int i = 0; i < (int)reset.size(); i++) {
 			for (int j = 0; j < (int)reset[i].tokens.size(); j++) {
-				p[place::type][reset[i].tokens[j].index].push_back(petri::iterator(transition::type, -i-1));
+				ctx.p[place::type][reset[i].tokens[j].index].push_back(petri::iterator(transition::type, -i-1));
+			}
+		}
+	}
+
+	// The groups of the one split being computed, kept apart from the groups
+	// stored in the nodes so that several splits may be computed at once.
+	// group[type][i] is the group of node (type, i) if stamp[type][i] ==
+	// epoch. Each thread reuses one of these from split to split.
+	//
+	// The forward traversal also keeps its frontier here. pending[type][i] is
+	// the group that node (type, i) would get if it were enabled, blocked if
+	// blocked[type][i] == epoch, and level[type][i] is the round at which it
+	// was first found blocked at a stuck merge if ordered[type][i] == epoch.
+	// queued[type][i] == visit keeps a node from being queued twice in one
+	// round.
+	struct split_scratch {
+		split_scratch() {
+			epoch = 0;
+			visit = 0;
+			resets = 0;
+			composition = choice;
+			split = 0;
+		}
+
+		array<vector<split_group>, 2> group;
+		array<vector<int>, 2> stamp;
+		int epoch;
+		vector<petri::iterator> touched;
+
+		array<vector<split_group>, 2> pending;
+		array<vector<int>, 2> blocked;
+		array<vector<int>, 2> ordered;
+		array<vector<int>, 2> level;
+		array<vector<int>, 2> queued;
+		int visit;
+
+		int resets;
+		int composition;
+		int split;
+
+		void start(const graph *g, int composition, int split) {
+			for (int type = 0; type < 2; type++) {
+				if ((int)stamp[type].size() < g->size(type)) {
+					stamp[type].resize(g->size(type), 0);
+					group[type].resize(g->size(type));
+					pending[type].resize(g->size(type));
+					blocked[type].resize(g->size(type), 0);
+					ordered[type].resize(g->size(type), 0);
+					level[type].resize(g->size(type), 0);
+					queued[type].resize(g->size(type), 0);
+				}
+			}
+			epoch++;
+			touched.clear();
+			resets = (int)g->reset.size();
+			this->composition = composition;
+			this->split = split;
+		}
+
+		// Mirrors split_groups_of() for the reset pseudo-transitions
+		split_group get(petri::iterator node) const {
+			if (node.index < 0) {
+				if (node.type == transition::type and composition == choice and resets > 1 and split == -1) {
+					return split_group(-1, resets, vector<int>(1, node.index));
+				}
+				return split_group();
+			} else if (stamp[node.type][node.index] == epoch) {
+				return group[node.type][node.index];
+			}
+			return split_group();
+		}
+
+		bool has(petri::iterator node) const {
+			return node.index >= 0 and stamp[node.type][node.index] == epoch;
+		}
+
+		void set(petri::iterator node, const split_group &g) {
+			if (node.index < 0) {
+				return;
+			}
+			if (stamp[node.type][node.index] != epoch) {
+				stamp[node.type][node.index] = epoch;
+				touched.push_back(node);
+			}
+			group[node.type][node.index] = g;
+		}
+
+		void erase(petri::iterator node) {
+			if (node.index >= 0) {
+				stamp[node.type][node.index] = 0;
 			}
 		}
+	};
+
+	// Queues the successors of node for the next round of the forward
+	// traversal in compute_split_group().
+	void queue_split_successors(petri::iterator node, const split_context &ctx, split_scratch &scratch, vector<petri::iterator> &dirty) const {
+		const vector<petri::iterator> &n = ctx.n[node.type][node.index];
+		for (auto j = n.begin(); j != n.end(); j++) {
+			if (scratch.queued[j->type][j->index] != scratch.visit) {
+				scratch.queued[j->type][j->index] = scratch.visit;
+				dirty.push_back(*j);
+			}
+		}
+	}
+
+	// Computes the groups of a single split into scratch and appends them to
+	// result. This only reads the graph, so it may run on several threads at
+	// once as long as the adjacency lists are up to date.
+	void compute_split_group(int composition, int split, const vector<petri::iterator> &init, const split_context &ctx, split_scratch &scratch, vector<pair<petri::iterator, split_group> > &result) const {
+		if (init.size() <= 1) {
+			// there is no split here
+			return;
+		}
+
+		const array<vector<vector<petri::iterator> >, 2> &p = ctx.p, &n = ctx.n;
+		scratch.start(this, composition, split);
 
 		petri::iterator splitNode(
 				composition == parallel ? transition::type : place::type,
@@ -395,7 +1065,7 @@ struct graph
 		seen.insert(init.begin(), init.end());
 		for (auto i = init.begin(); i != init.end(); i++) {
 			if (i->index >= 0) {
-				set_split_group(composition, *i, split_group(split, init.size(), {i->index}));
+				scratch.set(*i, split_group(split, init.size(), {i->index}));
 			}
 		}
 
@@ -406,73 +1076,119 @@ struct graph
 		// If we stop and wait for all of the branches of the merge, and we encounter multiple blocked merges, then how do we know which merge to unblock first? Because one of the blocked merges may lead to the next.
 		// unblock the merge that is closest to the split
 
-		// Forward iteration step
+		// Forward iteration step. Each round re-evaluates only the successors
+		// of the nodes that joined the split in the previous round, since no
+		// other node's inputs have changed. Nodes found blocked stay blocked
+		// until one of their inputs changes.
 		//cout << "start loop " << split << endl;
-		map<petri::iterator, split_group> enabled;
-		map<petri::iterator, int> order;
+		vector<petri::iterator> dirty;
+		scratch.visit++;
+		for (auto i = init.begin(); i != init.end(); i++) {
+			if (i->index >= 0) {
+				queue_split_successors(*i, ctx, scratch, dirty);
+			} else if (i->type == transition::type and -i->index-1 < (int)reset.size()) {
+				// the successors of a reset state are the places it marks
+				const vector<token> &tokens = reset[-i->index-1].tokens;
+				for (auto j = tokens.begin(); j != tokens.end(); j++) {
+					petri::iterator to(place::type, j->index);
+					if (scratch.queued[to.type][to.index] != scratch.visit) {
+						scratch.queued[to.type][to.index] = scratch.visit;
+						dirty.push_back(to);
+					}
+				}
+			}
+		}
+
+		vector<petri::iterator> enabled;
+		vector<petri::iterator> blocked;
 		int orderLevel = 0;
 		do {
 			enabled.clear();
 			//cout << "step " << ::to_string(seen) << endl;
 
-			map<petri::iterator, split_group> blocked;
-			for (int type = 0; type < 2; type++) {
-				for (petri::iterator to = begin(type); to != end(type); to++) {
-					bool isDisabled = false;
-					bool isEnabled = false;
-					split_group toSplit = get_split_group(composition, to, split);
-					// Ensure that we haven't encountered this split yet.
-					if (toSplit.split != split) {
-						toSplit.split = split;
-						toSplit.count = init.size();
-
-						// Check to make sure we've visited all of the input nodes and
-						// derive the split group for this node.
-						for (auto from = p[to.type][to.index].begin(); from != p[to.type][to.index].end(); from++) {
-							split_group fromSplit = get_split_group(composition, *from, split);
-							if (fromSplit.split != split) {
-								isDisabled = true;
-								if (type == transition::type
-									and (composition == choice
-										or (composition == parallel
-											and compare(split_group::NEGATIVE_DIFFERENCE, split_group::DIFFERENCE,
-												split_groups_of(choice, splitNode, false),
-												split_groups_of(choice, *from, false))))) {
-									toSplit.branch.clear();
-									break;
-								}
-								continue;
-							}
-							isEnabled = true;
-
-							if (from == p[to.type][to.index].begin()
-								or not (to.type == transition::type and composition == choice)) {
-								toSplit.branch.insert(
-									toSplit.branch.end(),
-									fromSplit.branch.begin(),
-									fromSplit.branch.end());
-								sort(toSplit.branch.begin(), toSplit.branch.end());
-								toSplit.branch.erase(unique(toSplit.branch.begin(), toSplit.branch.end()), toSplit.branch.end());
-							} else {
-								toSplit.branch = vector_intersection(toSplit.branch, fromSplit.branch);
-							}
-						}
+			for (auto to = dirty.begin(); to != dirty.end(); to++) {
+				// Ensure that we haven't encountered this split yet.
+				if (scratch.has(*to)) {
+					continue;
+				}
 
-						// If we've visited at least one of the input nodes, then this
-						// might be a blocked merge. If we've visited all of the input
-						// nodes, then we can make forward progress.
-						if (isEnabled and isDisabled) {
-							blocked.insert({to, toSplit});
-						} else if (isEnabled) {
-							enabled.insert({to, toSplit});
+				bool isDisabled = false;
+				bool isEnabled = false;
+				split_group toSplit;
+				toSplit.split = split;
+				toSplit.count = init.size();
+
+				// Check to make sure we've visited all of the input nodes and
+				// derive the split group for this node.
+				const vector<petri::iterator> &prev = p[to->type][to->index];
+				for (auto from = prev.begin(); from != prev.end(); from++) {
+					split_group fromSplit = scratch.get(*from);
+					if (fromSplit.split != split) {
+						isDisabled = true;
+						if (to->type == transition::type
+							and (composition == choice
+								or (composition == parallel
+									and compare(split_group::NEGATIVE_DIFFERENCE, split_group::DIFFERENCE,
+										split_groups_view(choice, splitNode, false),
+										split_groups_view(choice, *from, false))))) {
+							toSplit.branch.clear();
+							break;
 						}
+						continue;
+					}
+					isEnabled = true;
+
+					if (from == prev.begin()
+						or not (to->type == transition::type and composition == choice)) {
+						toSplit.branch.insert(
+							toSplit.branch.end(),
+							fromSplit.branch.begin(),
+							fromSplit.branch.end());
+						sort(toSplit.branch.begin(), toSplit.branch.end());
+						toSplit.branch.erase(unique(toSplit.branch.begin(), toSplit.branch.end()), toSplit.branch.end());
+					} else {
+						toSplit.branch = vector_intersection(toSplit.branch, fromSplit.branch);
+					}
+				}
+
+				// If we've visited at least one of the input nodes, then this
+				// might be a blocked merge. If we've visited all of the input
+				// nodes, then we can make forward progress.
+				int &isBlocked = scratch.blocked[to->type][to->index];
+				if (isEnabled and isDisabled) {
+					if (isBlocked != scratch.epoch) {
+						isBlocked = scratch.epoch;
+						blocked.push_back(*to);
 					}
+					scratch.pending[to->type][to->index] = toSplit;
+				} else if (isEnabled) {
+					isBlocked = 0;
+					scratch.pending[to->type][to->index] = toSplit;
+					enabled.push_back(*to);
+				} else {
+					isBlocked = 0;
 				}
 			}
-			
+			dirty.clear();
+			scratch.visit++;
+
 			//cout << "enabled: " << ::to_string(enabled) << endl;
 			//cout << "blocked: " << ::to_string(blocked) << endl;
 
+			if (enabled.empty() and not blocked.empty()) {
+				// Drop the nodes that have since been unblocked or visited
+				int k = 0;
+				for (int i = 0; i < (int)blocked.size(); i++) {
+					if (scratch.blocked[blocked[i].type][blocked[i].index] == scratch.epoch
+						and not scratch.has(blocked[i])) {
+						blocked[k++] = blocked[i];
+					}
+				}
+				blocked.resize(k);
+				sort(blocked.begin(), blocked.end());
+				blocked.erase(unique(blocked.begin(), blocked.end()), blocked.end());
+			}
+
 			if (enabled.empty() and not blocked.empty()) {
 				// We are stuck at a non-properly nested merge somewhere. We need to
 				// figure out where and then force progression through that merge. We
@@ -480,9 +1196,9 @@ struct graph
 				// precedes all of the others.
 
 				for (auto i = blocked.begin(); i != blocked.end(); i++) {
-					auto pos = order.find(i->first);
-					if (pos == order.end()) {
-						order.insert({i->first, orderLevel});
+					if (scratch.ordered[i->type][i->index] != scratch.epoch) {
+						scratch.ordered[i->type][i->index] = scratch.epoch;
+						scratch.level[i->type][i->index] = orderLevel;
 					}
 				}
 				orderLevel++;
@@ -490,44 +1206,45 @@ struct graph
 				//cout << ::to_string(order) << " " << to_string(seen) << endl;
 				auto first = blocked.begin();
 				for (auto i = ::next(blocked.begin()); i != blocked.end(); i++) {
-					bool AtoB = precedes(i->first, first->first, seen);
-					bool BtoA = precedes(first->first, i->first, seen);
+					bool AtoB = precedes(*i, *first, seen);
+					bool BtoA = precedes(*first, *i, seen);
 					if (AtoB and BtoA) {
-						auto orderA = order.find(i->first);
-						auto orderB = order.find(first->first);
-						if (orderB == order.end()
-							or (orderA != order.end() and orderA->second < orderB->second)) {
+						// every blocked node has been ordered above
+						if (scratch.level[i->type][i->index] < scratch.level[first->type][first->index]) {
 							first = i;
 						}
 					} else if (AtoB) {
 						first = i;
 					}
 				}
-				//cout << "forcing " << first->first << endl;
-				enabled.insert(*first);
+				//cout << "forcing " << *first << endl;
+				enabled.push_back(*first);
+				scratch.blocked[first->type][first->index] = 0;
 			}
 
 			for (auto i = enabled.begin(); i != enabled.end(); i++) {
-				sort(i->second.branch.begin(), i->second.branch.end());
-				i->second.branch.erase(
-					unique(i->second.branch.begin(), i->second.branch.end()),
-					i->second.branch.end());
-				if (n[i->first.type][i->first.index].empty()) {
-					//cout << "ready frontier end adding " << i->first << endl;
-					frontier.push_back(i->first);
-				}
-				for (auto j = n[i->first.type][i->first.index].begin(); j != n[i->first.type][i->first.index].end(); j++) {
-					if (get_split_group(composition, *j, split).split == split) {
-						//cout << "ready frontier loop adding " << i->first << endl;
-						frontier.push_back(i->first);
+				split_group &group = scratch.pending[i->type][i->index];
+				sort(group.branch.begin(), group.branch.end());
+				group.branch.erase(
+					unique(group.branch.begin(), group.branch.end()),
+					group.branch.end());
+				if (n[i->type][i->index].empty()) {
+					//cout << "ready frontier end adding " << *i << endl;
+					frontier.push_back(*i);
+				}
+				for (auto j = n[i->type][i->index].begin(); j != n[i->type][i->index].end(); j++) {
+					if (scratch.get(*j).split == split) {
+						//cout << "ready frontier loop adding " << *i << endl;
+						frontier.push_back(*i);
 					}
 				}
 			}
 
 			for (auto i = enabled.begin(); i != enabled.end(); i++) {
 				// replace the set of groups that exist at this location
-				set_split_group(composition, i->first, i->second);
-				seen.insert(i->first);
+				scratch.set(*i, scratch.pending[i->type][i->index]);
+				seen.insert(*i);
+				queue_split_successors(*i, ctx, scratch, dirty);
 			}
 		} while (not enabled.empty());
 		//cout << "done loop" << endl;
@@ -549,28 +1266,19 @@ struct graph
 			petri::iterator curr = todo.back();
 			todo.pop_back();
 		
-			bool found = false;	
-			vector<split_group> *cgroups = split_groups_iter(composition, curr);
-			if (cgroups != nullptr) {
-				for (int j = (int)cgroups->size()-1; j >= 0; j--) {
-					auto pos = cgroups->begin()+j;
-					if (pos->split == split and (pos->branch.empty() or (int)pos->branch.size() >= pos->count)) {
-						cgroups->erase(pos);
-						found = true;
-						break;
-					}
-				}
+			if (not scratch.has(curr)) {
+				continue;
 			}
-			if (not found) {
+			const split_group &cgroup = scratch.group[curr.type][curr.index];
+			if (not cgroup.branch.empty() and (int)cgroup.branch.size() < cgroup.count) {
 				continue;
 			}
+			scratch.erase(curr);
 
 			bool closed = true;
 			for (auto i = p[curr.type][curr.index].begin(); i != p[curr.type][curr.index].end() and closed; i++) {
-				vector<split_group> groups = split_groups_of(composition, *i, false);
-				for (auto j = groups.begin(); j != groups.end() and closed; j++) {
-					closed = (j->split != split or j->branch.empty() or (int)j->branch.size() >= j->count);
-				}
+				split_group group = scratch.get(*i);
+				closed = (group.split != split or group.branch.empty() or (int)group.branch.size() >= group.count);
 			}
 
 			if (closed) {
@@ -583,6 +1291,30 @@ struct graph
 		//cout << "done backtrack" << endl;
 		//print();
 		//cout << endl << endl;
+
+		// Fill in the branch masks from the positions of the branches in init
+		vector<pair<int, int> > position;
+		for (int i = 0; i < (int)init.size(); i++) {
+			position.push_back({init[i].index, i});
+		}
+		stable_sort(position.begin(), position.end(), [](const pair<int, int> &a, const pair<int, int> &b) {
+			return a.first < b.first;
+		});
+
+		for (auto i = scratch.touched.begin(); i != scratch.touched.end(); i++) {
+			if (scratch.has(*i)) {
+				result.push_back({*i, scratch.group[i->type][i->index]});
+				split_group &group = result.back().second;
+				group.mask.assign((group.count+63)/64, 0);
+				for (auto b = group.branch.begin(); b != group.branch.end(); b++) {
+					auto pos = lower_bound(position.begin(), position.end(), *b, [](const pair<int, int> &a, int b) {
+						return a.first < b;
+					});
+					group.set_mask(pos->second);
+				}
+				scratch.erase(*i);
+			}
+		}
 	}
 
 	// Analyzes and computes all split-merge relationships throughout the Petri net.
@@ -602,6 +1334,17 @@ struct graph
 	// The information computed by this function is essential for higher-level relationship
 	// analysis like determining if nodes are in sequence, choice, or parallel relationships.
 	virtual void compute_split_groups() const {
+		// The splits are computed on the thread pool, each into its own
+		// scratch, and the results are then merged into the nodes sorted by
+		// split so they do not depend on the schedule.
+		update_adjacency();
+		update_reset_groups();
+		split_context ctx;
+		build_split_context(ctx);
+		for (int type = 0; type < 2; type++) {
+			covered_groups[type].assign(size(type), vector<split_group>());
+		}
+
 		// DESIGN(edward.bingham) Choice must go first, because we use that to
 		// determine whether we're dealing with non-properly nested parallelism or
 		// shared conditional parallel branches. It just so happens that "choice" =
@@ -616,66 +1359,308 @@ struct graph
 				transitions[i].splits[composition].clear();
 			}
 
-			// each place belongs to some set of parallel splits (init[place])
-			if (composition == parallel) {
-				// add parallel splits from reset states
-				if (not reset.empty()) {
-					for (int i = 0; i < (int)reset.size(); i++) {
-						vector<petri::iterator> branches;
-						for (auto j = reset[i].tokens.begin(); j != reset[i].tokens.end(); j++) {
-							branches.push_back(petri::iterator(place::type, j->index));
-						}
-						compute_split_group(composition, -i-1, branches);
-					}
-				}
-			} else if (composition == choice) {
-				if (reset.size() > 1) {
+			vector<pair<int, vector<petri::iterator> > > jobs;
+			split_jobs(composition, ctx, jobs);
+			run_split_jobs(composition, jobs, ctx);
+
+			// See split_is_covered() for documentation. Remove "covered" conditional splits.
+			if (composition == choice) {
+				remove_covered_splits();
+			}
+		}
+		save_split_degrees();
+		split_groups_ready = true;
+		split_groups_stale = false;
+		split_touched.clear();
+		relations_ready = false;
+		split_pools_ready = false;
+		relations_too_large = false;
+	}
+
+	// Lists the splits of one composition along with the first branch nodes
+	// after each split.
+	void split_jobs(int composition, const split_context &ctx, vector<pair<int, vector<petri::iterator> > > &jobs) const {
+		// each place belongs to some set of parallel splits (init[place])
+		if (composition == parallel) {
+			// add parallel splits from reset states
+			if (not reset.empty()) {
+				for (int i = 0; i < (int)reset.size(); i++) {
 					vector<petri::iterator> branches;
-					for (int i = 0; i < (int)reset.size(); i++) {
-						branches.push_back(petri::iterator(transition::type, -i-1));
+					for (auto j = reset[i].tokens.begin(); j != reset[i].tokens.end(); j++) {
+						branches.push_back(petri::iterator(place::type, j->index));
 					}
-					compute_split_group(composition, -1, branches);
+					jobs.push_back({-i-1, branches});
+				}
+			}
+		} else if (composition == choice) {
+			if (reset.size() > 1) {
+				vector<petri::iterator> branches;
+				for (int i = 0; i < (int)reset.size(); i++) {
+					branches.push_back(petri::iterator(transition::type, -i-1));
 				}
+				jobs.push_back({-1, branches});
 			}
+		}
 
-			// A the moment, parallel == transition::type and choice == place::type,
-			// but that's not necessarily guaranteed.
-			int split_type = (composition == parallel ? transition::type : place::type);
+		// A the moment, parallel == transition::type and choice == place::type,
+		// but that's not necessarily guaranteed.
+		int split_type = (composition == parallel ? transition::type : place::type);
 
-			// add splits from graph structure at the first branch nodes after each split
-			for (petri::iterator i = begin(split_type); i != end(split_type); i++) {
-				compute_split_group(composition, i.index, next(i));
+		// add splits from graph structure at the first branch nodes after each split
+		for (petri::iterator i = begin(split_type); i != end(split_type); i = next_node(i)) {
+			if (ctx.n[split_type][i.index].size() > 1) {
+				jobs.push_back({i.index, ctx.n[split_type][i.index]});
 			}
+		}
+	}
 
-			// See split_is_covered() for documentation. Remove "covered" conditional splits.
-			if (composition == choice) {
-				set<int> covered;
-				for (petri::iterator i = begin(split_type); i != end(split_type); i++) {
-					if (split_is_covered(i, next(i))) {
-						covered.insert(i.index);
+	// Computes the given splits on the thread pool and adds their groups to
+	// the nodes, which must not have any groups for those splits yet.
+	void run_split_jobs(int composition, const vector<pair<int, vector<petri::iterator> > > &jobs, const split_context &ctx) const {
+		vector<split_scratch> scratch(threads());
+		vector<vector<pair<petri::iterator, split_group> > > results(threads());
+		parallel_for((int)jobs.size(), [this, composition, &jobs, &ctx, &scratch, &results](int thread, int i) {
+			compute_split_group(composition, jobs[i].first, jobs[i].second, ctx, scratch[thread], results[thread]);
+		});
+
+		for (auto result = results.begin(); result != results.end(); result++) {
+			for (auto i = result->begin(); i != result->end(); i++) {
+				split_groups_iter(composition, i->first)->push_back(i->second);
+			}
+		}
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = begin(type); i != end(type); i = next_node(i)) {
+				vector<split_group> *groups = split_groups_iter(composition, i);
+				sort(groups->begin(), groups->end());
+			}
+		}
+	}
+
+	// Moves the groups of the covered conditional splits out of the nodes and
+	// into covered_groups.
+	void remove_covered_splits() const {
+		set<int> covered;
+		for (petri::iterator i = begin(place::type); i != end(place::type); i = next_node(i)) {
+			if (split_is_covered(i, next(i))) {
+				covered.insert(i.index);
+			}
+		}
+
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = begin(type); i != end(type); i = next_node(i)) {
+				vector<split_group> *groups = split_groups_iter(choice, i);
+				for (int j = (int)groups->size()-1; j >= 0; j--) {
+					auto pos = groups->begin()+j;
+					if (covered.find(pos->split) != covered.end()) {
+						covered_groups[type][i.index].insert(covered_groups[type][i.index].begin(), *pos);
+						groups->erase(pos);
 					}
 				}
+			}
+		}
+	}
 
-				for (int type = 0; type < 2; type++) {
-					for (petri::iterator i = begin(type); i != end(type); i++) {
-						vector<split_group> *groups = split_groups_iter(choice, i);
-						for (int j = (int)groups->size()-1; j >= 0; j--) {
-							auto pos = groups->begin()+j;
-							if (covered.find(pos->split) != covered.end()) {
-								groups->erase(pos);
+	// Remember the number of arcs at every node once the split groups are
+	// complete, see update_split_groups().
+	void save_split_degrees() const {
+		for (int type = 0; type < 2; type++) {
+			split_degrees[type].resize(size(type));
+			for (int i = 0; i < size(type); i++) {
+				split_degrees[type][i] = {(int)outgoing(type, i).size(), (int)incoming(type, i).size()};
+			}
+		}
+	}
+
+	// Bring stale split groups up to date after local edits. Only the splits
+	// that have a group at a touched node or at one of its predecessors are
+	// recomputed, along with the splits at those nodes. A conditional split
+	// that changes invalidates the parallel splits found at the nodes whose
+	// conditional groups changed and their successors. The splits are assumed
+	// to be properly scoped by their groups: an edit past the point where all
+	// of the branches of a split have merged back together does not change
+	// that split. That only holds for edits that insert nodes in series with
+	// the existing ones, so an edit that changes the number of arcs into or
+	// out of an existing node falls back to a full recompute. Returns false
+	// if the edits touch too many of the splits or fall back, in which case
+	// the caller recomputes all of them.
+	bool update_split_groups() const {
+		// The nodes that existed when the groups were last complete
+		array<int, 2> known;
+		for (int type = 0; type < 2; type++) {
+			known[type] = (int)split_degrees[type].size();
+		}
+		if (known[place::type] > (int)places.size()
+			or known[transition::type] > (int)transitions.size()
+			or (int)covered_groups[place::type].size() != known[place::type]
+			or (int)covered_groups[transition::type].size() != known[transition::type]) {
+			return false;
+		}
+
+		update_adjacency();
+		update_reset_groups();
+		split_context ctx;
+		build_split_context(ctx);
+		for (int type = 0; type < 2; type++) {
+			covered_groups[type].resize(size(type));
+		}
+
+		// The touched nodes and their predecessors
+		array<vector<bool>, 2> marked;
+		marked[place::type].assign(places.size(), false);
+		marked[transition::type].assign(transitions.size(), false);
+		for (auto t = split_touched.begin(); t != split_touched.end(); t++) {
+			marked[t->type][t->index] = true;
+			const vector<petri::iterator> &prev = ctx.p[t->type][t->index];
+			for (auto i = prev.begin(); i != prev.end(); i++) {
+				if (i->index >= 0) {
+					marked[i->type][i->index] = true;
+				}
+			}
+		}
+		for (int type = 0; type < 2; type++) {
+			for (int i = 0; i < known[type]; i++) {
+				if (marked[type][i] and split_degrees[type][i] != pair<int, int>((int)outgoing(type, i).size(), (int)incoming(type, i).size())) {
+					return false;
+				}
+			}
+		}
+
+		// Split indices run from -reset.size() to the number of nodes
+		int offset = (int)reset.size();
+		vector<bool> affected;
+		auto find_affected = [this, offset, &marked, &affected](int composition) {
+			int split_type = (composition == parallel ? transition::type : place::type);
+			affected.assign(offset + size(split_type), false);
+			for (int i = 0; i < size(split_type); i++) {
+				affected[offset + i] = marked[split_type][i];
+			}
+			for (int type = 0; type < 2; type++) {
+				for (int i = 0; i < size(type); i++) {
+					if (marked[type][i]) {
+						const vector<split_group> &groups = *split_groups_iter(composition, petri::iterator(type, i));
+						for (auto g = groups.begin(); g != groups.end(); g++) {
+							affected[offset + g->split] = true;
+						}
+						if (composition == choice) {
+							for (auto g = covered_groups[type][i].begin(); g != covered_groups[type][i].end(); g++) {
+								affected[offset + g->split] = true;
 							}
 						}
 					}
 				}
 			}
+		};
+
+		auto affected_jobs = [offset, &affected](vector<pair<int, vector<petri::iterator> > > &jobs) {
+			int k = 0;
+			for (int i = 0; i < (int)jobs.size(); i++) {
+				if (affected[offset + jobs[i].first]) {
+					jobs[k++] = jobs[i];
+				}
+			}
+			jobs.resize(k);
+		};
+
+		auto remove_affected = [this, offset, &affected](vector<split_group> &groups) {
+			int k = 0;
+			for (int j = 0; j < (int)groups.size(); j++) {
+				if (not affected[offset + groups[j].split]) {
+					groups[k++] = groups[j];
+				}
+			}
+			groups.resize(k);
+		};
+
+		// conditional splits
+		find_affected(choice);
+		vector<pair<int, vector<petri::iterator> > > jobs;
+		split_jobs(choice, ctx, jobs);
+		int total = (int)jobs.size();
+		affected_jobs(jobs);
+		if (2*(int)jobs.size() > total) {
+			return false;
+		}
+
+		array<vector<vector<split_group> >, 2> prev_groups;
+		for (int type = 0; type < 2; type++) {
+			prev_groups[type].resize(size(type));
+			for (int i = 0; i < size(type); i++) {
+				vector<split_group> &groups = *split_groups_iter(choice, petri::iterator(type, i));
+				prev_groups[type][i] = groups;
+
+				// put the covered splits back to decide again whether they are covered
+				groups.insert(groups.end(), covered_groups[type][i].begin(), covered_groups[type][i].end());
+				covered_groups[type][i].clear();
+				remove_affected(groups);
+			}
 		}
+		run_split_jobs(choice, jobs, ctx);
+		remove_covered_splits();
+
+		// parallel splits
+		for (int type = 0; type < 2; type++) {
+			for (int i = 0; i < size(type); i++) {
+				if (*split_groups_iter(choice, petri::iterator(type, i)) != prev_groups[type][i]) {
+					marked[type][i] = true;
+					const vector<petri::iterator> &next = ctx.n[type][i];
+					for (auto j = next.begin(); j != next.end(); j++) {
+						marked[j->type][j->index] = true;
+					}
+				}
+			}
+		}
+		find_affected(parallel);
+		jobs.clear();
+		split_jobs(parallel, ctx, jobs);
+		affected_jobs(jobs);
+		for (int type = 0; type < 2; type++) {
+			for (int i = 0; i < size(type); i++) {
+				remove_affected(*split_groups_iter(parallel, petri::iterator(type, i)));
+			}
+		}
+		run_split_jobs(parallel, jobs, ctx);
+		save_split_degrees();
+
 		split_groups_ready = true;
+		split_groups_stale = false;
+		split_touched.clear();
+		relations_ready = false;
+		split_pools_ready = false;
+		relations_too_large = false;
+		return true;
 	}
 
 	virtual void mark_modified()
 	{
+		// Local edits keep a complete distance matrix around to be patched
+		if (local_edit_depth > 0 and (node_distances_ready or node_distances_stale)) {
+			node_distances_stale = true;
+		} else {
+			node_distances_stale = false;
+			distance_touched.clear();
+		}
+		if (local_edit_depth > 0 and (split_groups_ready or split_groups_stale)) {
+			split_groups_stale = true;
+		} else {
+			split_groups_stale = false;
+			split_touched.clear();
+		}
 		node_distances_ready = false;
+		reachability_ready = false;
 		split_groups_ready = false;
+		relations_ready = false;
+		split_pools_ready = false;
+		relations_too_large = false;
+		reset_adjacency();
+	}
+
+	// Called by the edits in this class in place of mark_modified(). They
+	// keep the adjacency lists up to date themselves, so those survive.
+	void mark_edited()
+	{
+		bool ready = adjacency_ready;
+		mark_modified();
+		adjacency_ready = ready;
 	}
 
 	virtual int size(int type=-1) const {
@@ -683,7 +1668,7 @@ struct graph
 	}
 
 	virtual petri::iterator begin(int type) const {
-		return petri::iterator(type, 0);
+		return next_node(petri::iterator(type, -1));
 	}
 
 	virtual petri::iterator end(int type) const {
@@ -691,13 +1676,104 @@ struct graph
 	}
 
 	virtual petri::iterator rbegin(int type) const {
-		return petri::iterator(type, size(type)-1);
+		return prev_node(petri::iterator(type, size(type)));
 	}
 
 	virtual petri::iterator rend(int type) const {
 		return petri::iterator(type, -1);
 	}
 
+	// Step to the next or previous node of the same type, skipping over the
+	// tombstones left behind by erase() in stable handle mode. An iterator
+	// doesn't know its graph, so ++ and -- don't skip them, and every loop
+	// over the nodes of a graph that may be in that mode steps with these.
+	petri::iterator next_node(petri::iterator i) const {
+		do {
+			i.index++;
+		} while (i.index < size(i.type) and is_tombstone(i));
+		return i;
+	}
+
+	petri::iterator prev_node(petri::iterator i) const {
+		do {
+			i.index--;
+		} while (i.index >= 0 and is_tombstone(i));
+		return i;
+	}
+
+	// In stable handle mode, erasing a node does not renumber the nodes after
+	// it. The erased node loses its arcs and tokens and is left behind as a
+	// tombstone, so every outstanding iterator stays valid and long chains of
+	// edits do no renumbering at all. compact() then removes every tombstone
+	// in a single pass. Leaving this mode compacts the graph.
+	virtual remapping set_stable_handles(bool stable) {
+		remapping result;
+		if (stable_handles and not stable) {
+			result = compact();
+		}
+		stable_handles = stable;
+		return result;
+	}
+
+	virtual bool is_tombstone(petri::iterator i) const {
+		return i.index >= 0 and i.index < (int)tombstones[i.type].size() and tombstones[i.type][i.index];
+	}
+
+	// The generation of the node in slot i. Erasing a node in stable handle
+	// mode and compacting the graph both change it, so a (node, generation)
+	// pair taken earlier tells whether the handle still names the same node.
+	int generation(petri::iterator i) const {
+		if (i.index >= 0 and i.index < (int)generations[i.type].size()) {
+			return generations[i.type][i.index];
+		}
+		return epoch;
+	}
+
+	bool is_valid(petri::iterator i, int gen) const {
+		return i.index >= 0 and i.index < size(i.type) and not is_tombstone(i) and generation(i) == gen;
+	}
+
+	// Remove every tombstone at once, renumbering the remaining nodes. Every
+	// node gets a new generation, so handles taken before the compaction are
+	// no longer valid and must be fixed up through the returned remapping.
+	virtual remapping compact() {
+		vector<petri::iterator> n;
+		for (int type = 0; type < 2; type++) {
+			for (int i = 0; i < (int)tombstones[type].size(); i++) {
+				if (tombstones[type][i]) {
+					n.push_back(petri::iterator(type, i));
+				}
+			}
+		}
+
+		for (int type = 0; type < 2; type++) {
+			for (auto g = generations[type].begin(); g != generations[type].end(); g++) {
+				epoch = max(epoch, *g);
+			}
+			tombstones[type].clear();
+			generations[type].clear();
+		}
+		epoch++;
+
+		bool stable = stable_handles;
+		stable_handles = false;
+		remapping result = erase_batch(n);
+		stable_handles = stable;
+		return result;
+	}
+
+	// Leave node i behind as a tombstone.
+	void bury(petri::iterator i) {
+		if (i.index >= (int)tombstones[i.type].size()) {
+			tombstones[i.type].resize(i.index+1, false);
+		}
+		if (i.index >= (int)generations[i.type].size()) {
+			generations[i.type].resize(i.index+1, epoch);
+		}
+		tombstones[i.type][i.index] = true;
+		generations[i.type][i.index]++;
+	}
+
 	virtual petri::iterator begin_arc(int type) const {
 		return petri::iterator(type, 0);
 	}
@@ -716,7 +1792,7 @@ struct graph
 
 	virtual petri::iterator create_at(place p, int index)
 	{
-		mark_modified();
+		mark_edited();
 		if (index >= (int)places.size()) {
 			places.resize(index+1);
 		}
@@ -726,7 +1802,7 @@ struct graph
 
 	virtual petri::iterator create_at(transition t, int index)
 	{
-		mark_modified();
+		mark_edited();
 		if (index >= (int)transitions.size()) {
 			transitions.resize(index+1);
 		}
@@ -736,14 +1812,16 @@ struct graph
 
 	virtual petri::iterator create(place p)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		places.push_back(p);
 		return petri::iterator(place::type, (int)places.size()-1);
 	}
 
 	virtual petri::iterator create(transition t)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		transitions.push_back(t);
 		return petri::iterator(transition::type, (int)transitions.size()-1);
 	}
@@ -760,7 +1838,8 @@ struct graph
 
 	virtual vector<petri::iterator> create(vector<place> p)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		vector<petri::iterator> result;
 		for (int i = 0; i < (int)p.size(); i++)
 		{
@@ -772,7 +1851,8 @@ struct graph
 
 	virtual vector<petri::iterator> create(vector<transition> t)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		vector<petri::iterator> result;
 		for (int i = 0; i < (int)t.size(); i++)
 		{
@@ -784,7 +1864,8 @@ struct graph
 
 	virtual vector<petri::iterator> create(place p, int num)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		vector<petri::iterator> result;
 		for (int i = 0; i < num; i++)
 		{
@@ -796,7 +1877,8 @@ struct graph
 
 	virtual vector<petri::iterator> create(transition t, int num)
 	{
-		mark_modified();
+		local_edit edit(this);
+		mark_edited();
 		vector<petri::iterator> result;
 		for (int i = 0; i < num; i++)
 		{
@@ -816,29 +1898,89 @@ struct graph
 			return vector<petri::iterator>();
 	}
 
+	// Renumber the arc indices stored in a set of adjacency lists after the
+	// arcs array they index was compacted. remap[i] is the new index of arc i
+	// or -1 if it was removed. The lists are sorted, so only the tail of each
+	// list past the first changed arc needs to be visited.
+	static void remap_adjacency(vector<vector<int> > &lists, const vector<int> &remap)
+	{
+		int first = 0;
+		while (first < (int)remap.size() and remap[first] == first)
+			first++;
+		if (first == (int)remap.size())
+			return;
+
+		for (auto l = lists.begin(); l != lists.end(); l++)
+		{
+			if (l->empty() or l->back() < first)
+				continue;
+
+			auto k = lower_bound(l->begin(), l->end(), first);
+			for (auto j = k; j != l->end(); j++)
+				if (remap[*j] >= 0)
+					*(k++) = remap[*j];
+			l->erase(k, l->end());
+		}
+	}
+
 	virtual pair<vector<petri::iterator>, vector<petri::iterator> > erase(petri::iterator n)
 	{
-		mark_modified();
 		pair<vector<petri::iterator>, vector<petri::iterator> > result;
-		for (int i = (int)arcs[n.type].size()-1; i >= 0; i--)
+		if (is_tombstone(n))
+			return result;
+
+		mark_edited();
+		update_adjacency();
+		const vector<int> &o = outgoing(n.type, n.index);
+		for (auto i = o.rbegin(); i != o.rend(); i++)
+			result.second.push_back(arcs[n.type][*i].to);
+		const vector<int> &p = incoming(n.type, n.index);
+		for (auto i = p.rbegin(); i != p.rend(); i++)
+			result.first.push_back(arcs[1-n.type][*i].from);
+
+		// Remove the arcs of n in a single pass over each arc array, shifting
+		// down the indices of the nodes after n unless the handles are stable.
+		// remap[type][i] is the new index of arcs[type][i], or -1 if it was
+		// removed.
+		array<vector<int>, 2> remap;
+		for (int type = 0; type < 2; type++)
 		{
-			if (arcs[n.type][i].from.index == n.index)
+			remap[type].resize(arcs[type].size());
+			int k = 0;
+			for (int i = 0; i < (int)arcs[type].size(); i++)
 			{
-				result.second.push_back(arcs[n.type][i].to);
-				arcs[n.type].erase(arcs[n.type].begin() + i);
+				petri::iterator &end = (type == n.type ? arcs[type][i].from : arcs[type][i].to);
+				if (end.index == n.index)
+				{
+					remap[type][i] = -1;
+					continue;
+				}
+				else if (not stable_handles and end.index > n.index)
+					end.index--;
+
+				remap[type][i] = k;
+				arcs[type][k++] = arcs[type][i];
 			}
-			else if (arcs[n.type][i].from.index > n.index)
-				arcs[n.type][i].from.index--;
+			arcs[type].resize(k);
 		}
-		for (int i = (int)arcs[1-n.type].size()-1; i >= 0; i--)
+
+		if (stable_handles)
 		{
-			if (arcs[1-n.type][i].to.index == n.index)
-			{
-				result.first.push_back(arcs[1-n.type][i].from);
-				arcs[1-n.type].erase(arcs[1-n.type].begin() + i);
-			}
-			else if (arcs[1-n.type][i].to.index > n.index)
-				arcs[1-n.type][i].to.index--;
+			out_list(n.type, n.index).clear();
+			in_list(n.type, n.index).clear();
+		}
+		else
+		{
+			if (n.index < (int)out_arcs[n.type].size())
+				out_arcs[n.type].erase(out_arcs[n.type].begin() + n.index);
+			if (n.index < (int)in_arcs[n.type].size())
+				in_arcs[n.type].erase(in_arcs[n.type].begin() + n.index);
+		}
+		for (int type = 0; type < 2; type++)
+		{
+			remap_adjacency(out_arcs[type], remap[type]);
+			remap_adjacency(in_arcs[type], remap[1-type]);
+			adjacency_arcs[type] = (int)arcs[type].size();
 		}
 
 		if (n.type == place::type)
@@ -848,7 +1990,7 @@ struct graph
 				{
 					if (source[j].tokens[i].index == n.index)
 						source[j].tokens.erase(source[j].tokens.begin() + i);
-					else if (source[j].tokens[i].index > n.index)
+					else if (not stable_handles and source[j].tokens[i].index > n.index)
 						source[j].tokens[i].index--;
 				}
 
@@ -857,7 +1999,7 @@ struct graph
 				{
 					if (reset[j].tokens[i].index == n.index)
 						reset[j].tokens.erase(reset[j].tokens.begin() + i);
-					else if (reset[j].tokens[i].index > n.index)
+					else if (not stable_handles and reset[j].tokens[i].index > n.index)
 						reset[j].tokens[i].index--;
 				}
 
@@ -866,12 +2008,14 @@ struct graph
 				{
 					if (sink[j].tokens[i].index == n.index)
 						sink[j].tokens.erase(sink[j].tokens.begin() + i);
-					else if (sink[j].tokens[i].index > n.index)
+					else if (not stable_handles and sink[j].tokens[i].index > n.index)
 						sink[j].tokens[i].index--;
 				}
 		}
 
-		if (n.type == place::type)
+		if (stable_handles)
+			bury(n);
+		else if (n.type == place::type)
 			places.erase(places.begin() + n.index);
 		else if (n.type == transition::type)
 			transitions.erase(transitions.begin() + n.index);
@@ -940,33 +2084,165 @@ struct graph
 			}
 	}
 
-	virtual void erase(vector<petri::iterator> n, bool rsorted = false)
+	// Erase every node in n at once. The doomed nodes are marked, then the
+	// places, transitions, arcs, and the tokens of the source, reset, and sink
+	// states are each compacted in a single linear pass. Returns where every
+	// remaining node ended up so that the caller may fix up its own iterators.
+	// In stable handle mode, the doomed nodes are left behind as tombstones and
+	// the remaining nodes keep their index.
+	virtual remapping erase_batch(const vector<petri::iterator> &n)
 	{
-		if (!rsorted)
-			sort(n.rbegin(), n.rend());
+		mark_edited();
+		update_adjacency();
+
+		remapping result;
+		result.index[place::type].assign(places.size(), 0);
+		result.index[transition::type].assign(transitions.size(), 0);
+		for (auto i = n.begin(); i != n.end(); i++)
+			if (i->index >= 0 and i->index < (int)result.index[i->type].size())
+				result.index[i->type][i->index] = -1;
+
+		bool any = false;
+		for (int type = 0; type < 2; type++)
+		{
+			int k = 0;
+			for (auto i = result.index[type].begin(); i != result.index[type].end(); i++, k++)
+			{
+				if (*i < 0)
+				{
+					any = true;
+					if (not stable_handles)
+						k--;
+				}
+				else
+					*i = k;
+			}
+		}
 
-		for (int i = 0; i < (int)n.size(); i++)
-			erase(n[i]);
+		if (not any)
+			return result;
+
+		// remove the arcs of the erased nodes and renumber the rest
+		array<vector<int>, 2> remap;
+		for (int type = 0; type < 2; type++)
+		{
+			remap[type].resize(arcs[type].size());
+			int k = 0;
+			for (int i = 0; i < (int)arcs[type].size(); i++)
+			{
+				int from = result.index[type][arcs[type][i].from.index];
+				int to = result.index[1-type][arcs[type][i].to.index];
+				if (from < 0 or to < 0)
+				{
+					remap[type][i] = -1;
+					continue;
+				}
+
+				remap[type][i] = k;
+				arcs[type][k] = arcs[type][i];
+				arcs[type][k].from.index = from;
+				arcs[type][k++].to.index = to;
+			}
+			arcs[type].resize(k);
+		}
+
+		for (int type = 0; type < 2; type++)
+		{
+			for (int l = 0; l < 2; l++)
+			{
+				vector<vector<int> > &lists = (l == 0 ? out_arcs[type] : in_arcs[type]);
+				int k = 0;
+				for (int i = 0; i < (int)lists.size(); i++)
+				{
+					if (result.index[type][i] >= 0)
+						lists[k++].swap(lists[i]);
+					else if (stable_handles)
+						lists[k++].clear();
+				}
+				lists.resize(k);
+			}
+		}
+		for (int type = 0; type < 2; type++)
+		{
+			remap_adjacency(out_arcs[type], remap[type]);
+			remap_adjacency(in_arcs[type], remap[1-type]);
+			adjacency_arcs[type] = (int)arcs[type].size();
+		}
+
+		// remove the tokens in the erased places and renumber the rest
+		array<vector<state>*, 3> states = {&source, &reset, &sink};
+		for (auto s = states.begin(); s != states.end(); s++)
+			for (auto j = (*s)->begin(); j != (*s)->end(); j++)
+			{
+				int k = 0;
+				for (int i = 0; i < (int)j->tokens.size(); i++)
+				{
+					int index = result.index[place::type][j->tokens[i].index];
+					if (index >= 0)
+					{
+						j->tokens[k] = j->tokens[i];
+						j->tokens[k++].index = index;
+					}
+				}
+				j->tokens.resize(k);
+			}
+
+		if (stable_handles)
+		{
+			for (int type = 0; type < 2; type++)
+				for (int i = 0; i < (int)result.index[type].size(); i++)
+					if (result.index[type][i] < 0 and not is_tombstone(petri::iterator(type, i)))
+						bury(petri::iterator(type, i));
+			return result;
+		}
+
+		int k = 0;
+		for (int i = 0; i < (int)places.size(); i++)
+			if (result.index[place::type][i] >= 0)
+			{
+				if (k != i)
+					places[k] = std::move(places[i]);
+				k++;
+			}
+		places.resize(k);
+
+		k = 0;
+		for (int i = 0; i < (int)transitions.size(); i++)
+			if (result.index[transition::type][i] >= 0)
+			{
+				if (k != i)
+					transitions[k] = std::move(transitions[i]);
+				k++;
+			}
+		transitions.resize(k);
+
+		return result;
+	}
+
+	virtual void erase(vector<petri::iterator> n, bool rsorted = false)
+	{
+		erase_batch(n);
 	}
 
 	virtual petri::iterator connect(petri::iterator from, petri::iterator to)
 	{
+		local_edit edit(this);
 		if (from.type == place::type && to.type == place::type)
 		{
 			petri::iterator mid = create(transition());
-			arcs[from.type].push_back(arc(from, mid));
-			arcs[mid.type].push_back(arc(mid, to));
+			push_arc(arc(from, mid));
+			push_arc(arc(mid, to));
 		}
 		else if (from.type == transition::type && to.type == transition::type)
 		{
 			petri::iterator mid = create(place());
-			arcs[from.type].push_back(arc(from, mid));
-			arcs[mid.type].push_back(arc(mid, to));
+			push_arc(arc(from, mid));
+			push_arc(arc(mid, to));
 		}
 		else
 		{
-			mark_modified();
-			arcs[from.type].push_back(arc(from, to));
+			mark_edited();
+			push_arc(arc(from, to));
 		}
 		return to;
 	}
@@ -1016,8 +2292,47 @@ struct graph
 
 	virtual void disconnect(petri::iterator a)
 	{
-		mark_modified();
-		arcs[a.type].erase(arcs[a.type].begin() + a.index);
+		disconnect(vector<petri::iterator>(1, a));
+	}
+
+	// Remove several arcs, given in any order, in a single pass over each arc
+	// array. The arcs after them are renumbered like in erase_batch().
+	virtual void disconnect(const vector<petri::iterator> &a)
+	{
+		mark_edited();
+
+		// remap[type][i] is the new index of arcs[type][i], or -1 if it was
+		// removed.
+		array<vector<int>, 2> remap;
+		for (int type = 0; type < 2; type++)
+			remap[type].assign(arcs[type].size(), 0);
+		for (auto i = a.begin(); i != a.end(); i++)
+			if (i->index >= 0 and i->index < (int)remap[i->type].size())
+				remap[i->type][i->index] = -1;
+
+		for (int type = 0; type < 2; type++)
+		{
+			int k = 0;
+			for (int i = 0; i < (int)arcs[type].size(); i++)
+			{
+				if (remap[type][i] < 0)
+					continue;
+
+				remap[type][i] = k;
+				arcs[type][k++] = arcs[type][i];
+			}
+			arcs[type].resize(k);
+		}
+
+		if (adjacency_ready)
+		{
+			for (int type = 0; type < 2; type++)
+			{
+				remap_adjacency(out_arcs[type], remap[type]);
+				remap_adjacency(in_arcs[type], remap[1-type]);
+				adjacency_arcs[type] = (int)arcs[type].size();
+			}
+		}
 	}
 
 
@@ -1025,7 +2340,7 @@ struct graph
 	{
 		if (i.type == place::type && i.index < (int)places.size())
 		{
-			mark_modified();
+			mark_edited();
 			places.push_back(places[i.index]);
 			petri::iterator result(i.type, places.size()-1);
 			for (int j = 0; j < (int)source.size(); j++)
@@ -1056,7 +2371,7 @@ struct graph
 		}
 		else if (i.type == transition::type && i.index < (int)transitions.size())
 		{
-			mark_modified();
+			mark_edited();
 			transitions.push_back(transitions[i.index]);
 			return petri::iterator(i.type, transitions.size()-1);
 		}
@@ -1073,7 +2388,7 @@ struct graph
 		if (i.type == place::type && i.index < (int)places.size()) {
 			for (int j = 0; j < num; j++)
 			{
-				mark_modified();
+				mark_edited();
 				places.push_back(places[i.index]);
 				result.push_back(petri::iterator(i.type, places.size()-1));
 			}
@@ -1107,7 +2422,7 @@ struct graph
 		} else if (i.type == transition::type && i.index < (int)transitions.size()) {
 			for (int j = 0; j < num; j++)
 			{
-				mark_modified();
+				mark_edited();
 				transitions.push_back(transitions[i.index]);
 				result.push_back(petri::iterator(i.type, transitions.size()-1));
 			}
@@ -1231,9 +2546,9 @@ struct graph
 		petri::iterator i[2];
 		i[place::type] = create(n);
 		i[transition::type] = create(transition());
-		arcs[a.type].push_back(arc(i[a.type], arcs[a.type][a.index].to));
-		arcs[1-a.type].push_back(arc(i[1-a.type], i[a.type]));
-		arcs[a.type][a.index].to = i[1-a.type];
+		push_arc(arc(i[a.type], arcs[a.type][a.index].to));
+		push_arc(arc(i[1-a.type], i[a.type]));
+		move_arc(a, arcs[a.type][a.index].from, i[1-a.type]);
 		return i[place::type];
 	}
 
@@ -1242,9 +2557,9 @@ struct graph
 		petri::iterator i[2];
 		i[place::type] = create(place());
 		i[transition::type] = create(n);
-		arcs[a.type].push_back(arc(i[a.type], arcs[a.type][a.index].to));
-		arcs[1-a.type].push_back(arc(i[1-a.type], i[a.type]));
-		arcs[a.type][a.index].to = i[1-a.type];
+		push_arc(arc(i[a.type], arcs[a.type][a.index].to));
+		push_arc(arc(i[1-a.type], i[a.type]));
+		move_arc(a, arcs[a.type][a.index].from, i[1-a.type]);
 		return i[transition::type];
 	}
 
@@ -1260,6 +2575,7 @@ struct graph
 
 	virtual petri::iterator insert_alongside(petri::iterator from, petri::iterator to, place n)
 	{
+		local_edit edit(this);
 		petri::iterator i = create(n);
 		if (from.type == i.type)
 		{
@@ -1284,6 +2600,7 @@ struct graph
 
 	virtual petri::iterator insert_alongside(petri::iterator from, petri::iterator to, transition n)
 	{
+		local_edit edit(this);
 		petri::iterator i = create(n);
 		if (from.type == i.type)
 		{
@@ -1318,12 +2635,13 @@ struct graph
 
 	virtual petri::iterator insert_before(petri::iterator to, place n)
 	{
+		local_edit edit(this);
 		petri::iterator i[2];
 		i[transition::type] = create(transition());
 		i[place::type] = create(n);
-		for (int j = 0; j < (int)arcs[1-to.type].size(); j++)
-			if (arcs[1-to.type][j].to.index == to.index)
-				arcs[1-to.type][j].to.index = i[to.type].index;
+		vector<petri::iterator> a = in(to);
+		for (auto j = a.begin(); j != a.end(); j++)
+			move_arc(*j, arcs[j->type][j->index].from, i[to.type]);
 		connect(i[1-to.type], to);
 		connect(i[to.type], i[1-to.type]);
 		return i[place::type];
@@ -1331,12 +2649,13 @@ struct graph
 
 	virtual petri::iterator insert_before(petri::iterator to, transition n)
 	{
+		local_edit edit(this);
 		petri::iterator i[2];
 		i[transition::type] = create(n);
 		i[place::type] = create(place());
-		for (int j = 0; j < (int)arcs[1-to.type].size(); j++)
-			if (arcs[1-to.type][j].to.index == to.index)
-				arcs[1-to.type][j].to.index = i[to.type].index;
+		vector<petri::iterator> a = in(to);
+		for (auto j = a.begin(); j != a.end(); j++)
+			move_arc(*j, arcs[j->type][j->index].from, i[to.type]);
 		connect(i[1-to.type], to);
 		connect(i[to.type], i[1-to.type]);
 		return i[transition::type];
@@ -1354,12 +2673,13 @@ struct graph
 
 	virtual petri::iterator insert_after(petri::iterator from, place n)
 	{
+		local_edit edit(this);
 		petri::iterator i[2];
 		i[transition::type] = create(transition());
 		i[place::type] = create(n);
-		for (int j = 0; j < (int)arcs[from.type].size(); j++)
-			if (arcs[from.type][j].from.index == from.index)
-				arcs[from.type][j].from.index = i[from.type].index;
+		vector<petri::iterator> a = out(from);
+		for (auto j = a.begin(); j != a.end(); j++)
+			move_arc(*j, i[from.type], arcs[j->type][j->index].to);
 		connect(from, i[1-from.type]);
 		connect(i[1-from.type], i[from.type]);
 		return i[place::type];
@@ -1368,12 +2688,13 @@ struct graph
 
 	virtual petri::iterator insert_after(petri::iterator from, transition n)
 	{
+		local_edit edit(this);
 		petri::iterator i[2];
 		i[transition::type] = create(n);
 		i[place::type] = create(place());
-		for (int j = 0; j < (int)arcs[from.type].size(); j++)
-			if (arcs[from.type][j].from.index == from.index)
-				arcs[from.type][j].from.index = i[from.type].index;
+		vector<petri::iterator> a = out(from);
+		for (auto j = a.begin(); j != a.end(); j++)
+			move_arc(*j, i[from.type], arcs[j->type][j->index].to);
 		connect(from, i[1-from.type]);
 		connect(i[1-from.type], i[from.type]);
 		return i[transition::type];
@@ -1405,10 +2726,9 @@ struct graph
 				p = create(place::type);
 				connect(p, t);
 			}
-			for (auto j = arcs[1-i->type].begin(); j != arcs[1-i->type].end(); j++) {
-				if (j->to.index == i->index) {
-					j->to.index = p.index;
-				}
+			vector<petri::iterator> a = in(*i);
+			for (auto j = a.begin(); j != a.end(); j++) {
+				move_arc(*j, arcs[j->type][j->index].from, p);
 			}
 			connect(t, *i);
 		}
@@ -1432,12 +2752,12 @@ struct graph
 			vector<petri::iterator> x = create(1-i.type, 4);
 			vector<petri::iterator> y = create(i.type, 2);
 
-			for (int j = (int)arcs[i.type].size()-1; j >= 0; j--)
-				if (arcs[i.type][j].from == i)
-					arcs[i.type][j].from = y[1];
-			for (int j = (int)arcs[1-i.type].size()-1; j >= 0; j--)
-				if (arcs[1-i.type][j].to == i)
-					arcs[1-i.type][j].to = y[0];
+			vector<petri::iterator> o = out(i);
+			for (auto j = o.begin(); j != o.end(); j++)
+				move_arc(*j, y[1], arcs[j->type][j->index].to);
+			vector<petri::iterator> a = in(i);
+			for (auto j = a.begin(); j != a.end(); j++)
+				move_arc(*j, arcs[j->type][j->index].from, y[0]);
 
 			connect(y[0], x[0]);
 			connect(y[0], x[1]);
@@ -1453,10 +2773,10 @@ struct graph
 			vector<petri::iterator> n = next(i);
 			vector<petri::iterator> p = prev(i);
 
-			for (int j = 0; j < 2; j++)
-				for (int k = (int)arcs[j].size()-1; k >= 0; k--)
-					if (arcs[j][k].from == i || arcs[j][k].to == i)
-						arcs[j].erase(arcs[j].begin() + k);
+			vector<petri::iterator> a = out(i);
+			vector<petri::iterator> b = in(i);
+			a.insert(a.end(), b.begin(), b.end());
+			disconnect(a);
 
 			vector<petri::iterator> n1, p1;
 			for (int l = 0; l < (int)n.size(); l++)
@@ -1497,12 +2817,12 @@ struct graph
 			vector<petri::iterator> y = create(i.type, 2);
 			vector<petri::iterator> z = create(1-i.type, 2);
 
-			for (int j = (int)arcs[i.type].size()-1; j >= 0; j--)
-				if (arcs[i.type][j].from == i)
-					arcs[i.type][j].from = y[1];
-			for (int j = (int)arcs[1-i.type].size()-1; j >= 0; j--)
-				if (arcs[1-i.type][j].to == i)
-					arcs[1-i.type][j].to = y[0];
+			vector<petri::iterator> o = out(i);
+			for (auto j = o.begin(); j != o.end(); j++)
+				move_arc(*j, y[1], arcs[j->type][j->index].to);
+			vector<petri::iterator> a = in(i);
+			for (auto j = a.begin(); j != a.end(); j++)
+				move_arc(*j, arcs[j->type][j->index].from, y[0]);
 
 			connect(y[0], z[0]);
 			connect(z[0], i);
@@ -1522,10 +2842,10 @@ struct graph
 			vector<petri::iterator> n = next(i);
 			vector<petri::iterator> p = prev(i);
 
-			for (int j = 0; j < 2; j++)
-				for (int k = (int)arcs[j].size()-1; k >= 0; k--)
-					if (arcs[j][k].from == i || arcs[j][k].to == i)
-						arcs[j].erase(arcs[j].begin() + k);
+			vector<petri::iterator> a = out(i);
+			vector<petri::iterator> b = in(i);
+			a.insert(a.end(), b.begin(), b.end());
+			disconnect(a);
 
 			for (int k = 0; k < num-1; k++)
 			{
@@ -1594,13 +2914,13 @@ struct graph
 		{
 			combine(sequence, left[i], right[i]);
 
-			for (int j = 0; j < (int)arcs[right[i].type].size(); j++)
-				if (arcs[right[i].type][j].from == right[i])
-					arcs[right[i].type][j].from = left[i];
+			vector<petri::iterator> o = out(right[i]);
+			for (auto j = o.begin(); j != o.end(); j++)
+				move_arc(*j, left[i], arcs[j->type][j->index].to);
 
-			for (int j = 0; j < (int)arcs[1-right[i].type].size(); j++)
-				if (arcs[1-right[i].type][j].to == right[i])
-					arcs[1-right[i].type][j].to = left[i];
+			vector<petri::iterator> a = in(right[i]);
+			for (auto j = a.begin(); j != a.end(); j++)
+				move_arc(*j, arcs[j->type][j->index].from, left[i]);
 
 			if (right[i].type == place::type)
 			{
@@ -1630,21 +2950,159 @@ struct graph
 			}
 		}
 
-		erase(right);
-		erase(right, left);
+		erase_batch(right).apply(left);
+
+		map<petri::iterator, vector<petri::iterator> > result;
+		for (int i = 0; i < (int)left.size(); i++)
+			result.insert(pair<petri::iterator, vector<petri::iterator> >(right[i], vector<petri::iterator>(1, left[i])));
+		return result;
+	}
+
+	// Rebuild the adjacency lists from scratch. This is only needed when arcs
+	// was edited directly, since every edit in this class updates the lists
+	// in place.
+	virtual void update_adjacency() const {
+		if (adjacency_ready
+			and adjacency_arcs[place::type] == (int)arcs[place::type].size()
+			and adjacency_arcs[transition::type] == (int)arcs[transition::type].size()) {
+			return;
+		}
+
+		for (int type = 0; type < 2; type++) {
+			out_arcs[type].clear();
+			in_arcs[type].clear();
+			out_arcs[type].resize(size(type));
+			in_arcs[type].resize(size(type));
+		}
+
+		for (int type = 0; type < 2; type++) {
+			for (int i = 0; i < (int)arcs[type].size(); i++) {
+				out_list(type, arcs[type][i].from.index).push_back(i);
+				in_list(1-type, arcs[type][i].to.index).push_back(i);
+			}
+			adjacency_arcs[type] = (int)arcs[type].size();
+		}
+		adjacency_ready = true;
+	}
+
+	virtual void reset_adjacency() const {
+		adjacency_ready = false;
+	}
+
+	// The indices of the arcs in arcs[type] that leave node (type, n).
+	const vector<int> &outgoing(int type, int n) const {
+		static const vector<int> empty;
+		update_adjacency();
+		if (n < 0 or n >= (int)out_arcs[type].size()) {
+			return empty;
+		}
+		return out_arcs[type][n];
+	}
+
+	// The indices of the arcs in arcs[1-type] that enter node (type, n).
+	const vector<int> &incoming(int type, int n) const {
+		static const vector<int> empty;
+		update_adjacency();
+		if (n < 0 or n >= (int)in_arcs[type].size()) {
+			return empty;
+		}
+		return in_arcs[type][n];
+	}
+
+	// Mutable access to the adjacency lists for the edits below. Arcs are
+	// allowed to reference nodes that haven't been created yet, so these grow
+	// the lists as needed.
+	vector<int> &out_list(int type, int n) const {
+		if (n >= (int)out_arcs[type].size()) {
+			out_arcs[type].resize(n+1);
+		}
+		return out_arcs[type][n];
+	}
+
+	vector<int> &in_list(int type, int n) const {
+		if (n >= (int)in_arcs[type].size()) {
+			in_arcs[type].resize(n+1);
+		}
+		return in_arcs[type][n];
+	}
+
+	// Append an arc, keeping the adjacency lists up to date. The caller is
+	// responsible for calling mark_edited().
+	petri::iterator push_arc(arc a) {
+		int type = a.from.type;
+		arcs[type].push_back(a);
+		touch_distances(a.to);
+		touch_splits(a.to);
+		if (adjacency_ready) {
+			int index = (int)arcs[type].size()-1;
+			out_list(type, a.from.index).push_back(index);
+			in_list(1-type, a.to.index).push_back(index);
+			adjacency_arcs[type]++;
+		}
+		return petri::iterator(type, (int)arcs[type].size()-1);
+	}
+
+	// Change the endpoints of an existing arc, keeping the adjacency lists up
+	// to date. The caller is responsible for calling mark_edited().
+	void move_arc(petri::iterator a, petri::iterator from, petri::iterator to) {
+		arc &curr = arcs[a.type][a.index];
+		touch_distances(curr.to);
+		touch_distances(to);
+		touch_splits(curr.from);
+		touch_splits(curr.to);
+		touch_splits(to);
+		if (adjacency_ready) {
+			vector<int> &o0 = out_list(a.type, curr.from.index);
+			o0.erase(lower_bound(o0.begin(), o0.end(), a.index));
+			vector<int> &i0 = in_list(1-a.type, curr.to.index);
+			i0.erase(lower_bound(i0.begin(), i0.end(), a.index));
+
+			vector<int> &o1 = out_list(a.type, from.index);
+			o1.insert(lower_bound(o1.begin(), o1.end(), a.index), a.index);
+			vector<int> &i1 = in_list(1-a.type, to.index);
+			i1.insert(lower_bound(i1.begin(), i1.end(), a.index), a.index);
+		}
+		curr.from = from;
+		curr.to = to;
+	}
+
+	// The sorted indices of the arcs in arcs[type] that leave any of the nodes
+	// in n. Sorting keeps the results of the vector overloads in arc order.
+	vector<int> out_arcs_of(int type, vector<int> n) const {
+		sort(n.begin(), n.end());
+		n.erase(unique(n.begin(), n.end()), n.end());
+
+		vector<int> result;
+		for (auto i = n.begin(); i != n.end(); i++) {
+			const vector<int> &o = outgoing(type, *i);
+			result.insert(result.end(), o.begin(), o.end());
+		}
+		sort(result.begin(), result.end());
+		return result;
+	}
+
+	// The sorted indices of the arcs in arcs[1-type] that enter any of the
+	// nodes in n.
+	vector<int> in_arcs_of(int type, vector<int> n) const {
+		sort(n.begin(), n.end());
+		n.erase(unique(n.begin(), n.end()), n.end());
 
-		map<petri::iterator, vector<petri::iterator> > result;
-		for (int i = 0; i < (int)left.size(); i++)
-			result.insert(pair<petri::iterator, vector<petri::iterator> >(right[i], vector<petri::iterator>(1, left[i])));
+		vector<int> result;
+		for (auto i = n.begin(); i != n.end(); i++) {
+			const vector<int> &o = incoming(type, *i);
+			result.insert(result.end(), o.begin(), o.end());
+		}
+		sort(result.begin(), result.end());
 		return result;
 	}
 
 	virtual vector<petri::iterator> next(petri::iterator n) const
 	{
 		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[n.type].size(); i++)
-			if (arcs[n.type][i].from.index == n.index)
-				result.push_back(arcs[n.type][i].to);
+		const vector<int> &o = outgoing(n.type, n.index);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(arcs[n.type][*i].to);
 		return result;
 	}
 
@@ -1662,9 +3120,10 @@ struct graph
 	virtual vector<petri::iterator> prev(petri::iterator n) const
 	{
 		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[1-n.type].size(); i++)
-			if (arcs[1-n.type][i].to.index == n.index)
-				result.push_back(arcs[1-n.type][i].from);
+		const vector<int> &o = incoming(n.type, n.index);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(arcs[1-n.type][*i].from);
 		return result;
 	}
 
@@ -1681,14 +3140,9 @@ struct graph
 
 	virtual vector<petri::iterator> neighbors(petri::iterator n, bool sorted = false) const
 	{
-		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[1-n.type].size(); i++)
-			if (arcs[1-n.type][i].to.index == n.index)
-				result.push_back(arcs[1-n.type][i].from);
-
-		for (int i = 0; i < (int)arcs[n.type].size(); i++)
-			if (arcs[n.type][i].from.index == n.index)
-				result.push_back(arcs[n.type][i].to);
+		vector<petri::iterator> result = prev(n);
+		vector<petri::iterator> temp = next(n);
+		result.insert(result.end(), temp.begin(), temp.end());
 
 		if (sorted)
 			sort(result.begin(), result.end());
@@ -1698,49 +3152,44 @@ struct graph
 	virtual vector<int> next(int type, int n) const
 	{
 		vector<int> result;
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (arcs[type][i].from.index == n)
-				result.push_back(arcs[type][i].to.index);
+		const vector<int> &o = outgoing(type, n);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(arcs[type][*i].to.index);
 		return result;
 	}
 
 	virtual vector<int> next(int type, vector<int> n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[type][i].from.index) != n.end())
-				result.push_back(arcs[type][i].to.index);
+		vector<int> result = out_arcs_of(type, n);
+		for (int i = 0; i < (int)result.size(); i++)
+			result[i] = arcs[type][result[i]].to.index;
 		return result;
 	}
 
 	virtual vector<int> prev(int type, int n) const
 	{
 		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (arcs[1-type][i].to.index == n)
-				result.push_back(arcs[1-type][i].from.index);
+		const vector<int> &o = incoming(type, n);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(arcs[1-type][*i].from.index);
 		return result;
 	}
 
 	virtual vector<int> prev(int type, vector<int> n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[1-type][i].to.index) != n.end())
-				result.push_back(arcs[1-type][i].from.index);
+		vector<int> result = in_arcs_of(type, n);
+		for (int i = 0; i < (int)result.size(); i++)
+			result[i] = arcs[1-type][result[i]].from.index;
 		return result;
 	}
 
 	virtual vector<int> neighbors(int type, int n, bool sorted = false) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (arcs[1-type][i].to.index == n)
-				result.push_back(arcs[1-type][i].from.index);
-
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (arcs[type][i].from.index == n)
-				result.push_back(arcs[type][i].to.index);
+		vector<int> result = prev(type, n);
+		vector<int> temp = next(type, n);
+		result.insert(result.end(), temp.begin(), temp.end());
 
 		if (sorted)
 			sort(result.begin(), result.end());
@@ -1750,14 +3199,9 @@ struct graph
 
 	virtual vector<int> neighbors(int type, vector<int> n, bool sorted = false) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[1-type][i].to.index) != n.end())
-				result.push_back(arcs[1-type][i].from.index);
-
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[type][i].from.index) != n.end())
-				result.push_back(arcs[type][i].to.index);
+		vector<int> result = prev(type, n);
+		vector<int> temp = next(type, n);
+		result.insert(result.end(), temp.begin(), temp.end());
 
 		if (sorted)
 			sort(result.begin(), result.end());
@@ -1768,9 +3212,10 @@ struct graph
 	virtual vector<petri::iterator> out(petri::iterator n) const
 	{
 		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[n.type].size(); i++)
-			if (arcs[n.type][i].from.index == n.index)
-				result.push_back(petri::iterator(n.type, i));
+		const vector<int> &o = outgoing(n.type, n.index);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(petri::iterator(n.type, *i));
 		return result;
 	}
 
@@ -1788,9 +3233,10 @@ struct graph
 	virtual vector<petri::iterator> in(petri::iterator n) const
 	{
 		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[1-n.type].size(); i++)
-			if (arcs[1-n.type][i].to.index == n.index)
-				result.push_back(petri::iterator(1-n.type, i));
+		const vector<int> &o = incoming(n.type, n.index);
+		result.reserve(o.size());
+		for (auto i = o.begin(); i != o.end(); i++)
+			result.push_back(petri::iterator(1-n.type, *i));
 		return result;
 	}
 
@@ -1807,47 +3253,27 @@ struct graph
 
 	virtual vector<int> out(int type, int n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (arcs[type][i].from.index == n)
-				result.push_back(i);
-		return result;
+		return outgoing(type, n);
 	}
 
 	virtual vector<int> out(int type, vector<int> n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[type][i].from.index) != n.end())
-				result.push_back(i);
-		return result;
+		return out_arcs_of(type, n);
 	}
 
 	virtual vector<int> in(int type, int n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (arcs[1-type][i].to.index == n)
-				result.push_back(i);
-		return result;
+		return incoming(type, n);
 	}
 
 	virtual vector<int> in(int type, vector<int> n) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (find(n.begin(), n.end(), arcs[1-type][i].to.index) != n.end())
-				result.push_back(i);
-		return result;
+		return in_arcs_of(type, n);
 	}
 
 	virtual vector<petri::iterator> next_arcs(petri::iterator a) const
 	{
-		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[1-a.type].size(); i++)
-			if (arcs[1-a.type][i].from == arcs[a.type][a.index].to)
-				result.push_back(petri::iterator(1-a.type, i));
-		return result;
+		return out(arcs[a.type][a.index].to);
 	}
 
 	virtual vector<petri::iterator> next_arcs(vector<petri::iterator> a) const
@@ -1863,11 +3289,7 @@ struct graph
 
 	virtual vector<petri::iterator> prev_arcs(petri::iterator a) const
 	{
-		vector<petri::iterator> result;
-		for (int i = 0; i < (int)arcs[1-a.type].size(); i++)
-			if (arcs[1-a.type][i].to == arcs[a.type][a.index].from)
-				result.push_back(petri::iterator(1-a.type, i));
-		return result;
+		return in(arcs[a.type][a.index].from);
 	}
 
 	virtual vector<petri::iterator> prev_arcs(vector<petri::iterator> a) const
@@ -1883,11 +3305,7 @@ struct graph
 
 	virtual vector<int> next_arcs(int type, int a) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (arcs[1-type][i].from == arcs[type][a].to)
-				result.push_back(i);
-		return result;
+		return out(1-type, arcs[type][a].to.index);
 	}
 
 	virtual vector<int> next_arcs(int type, vector<int> a) const
@@ -1903,11 +3321,7 @@ struct graph
 
 	virtual vector<int> prev_arcs(int type, int a) const
 	{
-		vector<int> result;
-		for (int i = 0; i < (int)arcs[1-type].size(); i++)
-			if (arcs[1-type][i].to == arcs[type][a].from)
-				result.push_back(i);
-		return result;
+		return in(type, arcs[type][a].from.index);
 	}
 
 	virtual vector<int> prev_arcs(int type, vector<int> a) const
@@ -1955,7 +3369,18 @@ struct graph
 			reset = g.reset;
 			node_distances = g.node_distances;
 			node_distances_ready = g.node_distances_ready;
+			node_distances_stale = false;
+			distance_size = g.distance_size;
+			reachability_ready = false;
 			split_groups_ready = g.split_groups_ready;
+			split_groups_stale = false;
+			split_touched.clear();
+			covered_groups = g.covered_groups;
+			split_degrees = g.split_degrees;
+			relations_ready = false;
+			split_pools_ready = false;
+			relations_too_large = false;
+			reset_adjacency();
 
 			map<petri::iterator, vector<petri::iterator> > result;
 			for (int i = 0; i < (int)places.size(); i++)
@@ -1970,7 +3395,7 @@ struct graph
 			return map<petri::iterator, vector<petri::iterator> >();
 		else
 		{
-			mark_modified();
+			mark_edited();
 			map<petri::iterator, vector<petri::iterator> > result;
 
 			places.reserve(places.size() + g.places.size());
@@ -1994,7 +3419,7 @@ struct graph
 					vector<petri::iterator> to = result[g.arcs[i][j].to];
 					for (int k = 0; k < (int)from.size(); k++)
 						for (int l = 0; l < (int)to.size(); l++)
-							arcs[i].push_back(arc(from[k], to[l]));
+							push_arc(arc(from[k], to[l]));
 				}
 
 			vector<state> converted_source;
@@ -2635,6 +4060,12 @@ struct graph
 
 			for (petri::iterator i(transition::type, 0); i < (int)transitions.size() && !change; )
 			{
+				if (is_tombstone(i))
+				{
+					i++;
+					continue;
+				}
+
 				vector<petri::iterator> n = next(i);
 				vector<petri::iterator> p = prev(i);
 
@@ -2713,6 +4144,12 @@ struct graph
 
 			for (petri::iterator i(place::type, 0); i < (int)places.size() && !change; )
 			{
+				if (is_tombstone(i))
+				{
+					i++;
+					continue;
+				}
+
 				bool i_is_reset = is_reset(i);
 
 				vector<petri::iterator> n = next(i);
@@ -2727,14 +4164,20 @@ struct graph
 				// This means that its output transitions will never fire.
 				if (p.size() == 0 && (!i_is_reset || n.size() == 0))
 				{
-					erase(n);
-					erase(i);
+					n.push_back(i);
+					erase_batch(n);
 					affect = true;
 				}
 
 				// Check to see if there are any excess places whose existence doesn't affect the behavior of the circuit
 				for (petri::iterator j = i+1; j < (int)places.size(); )
 				{
+					if (is_tombstone(j))
+					{
+						j++;
+						continue;
+					}
+
 					bool j_is_reset = is_reset(j);
 
 					vector<petri::iterator> n2 = next(j);
@@ -2789,8 +4232,11 @@ struct graph
 						sort(px.back().back().second.begin(), px.back().back().second.end());
 					}
 
-					for (petri::iterator j = i-1; j >= 0 && !change; j--)
+					for (petri::iterator j = i-1; j >= 0 && !change && !is_tombstone(i); j--)
 					{
+						if (is_tombstone(j))
+							continue;
+
 						// Find internally conditioned transitions. Transitions are internally conditioned if they are the same type
 						// share all of the same input and output places.
 						if (n[j.index] == n[i.index] && p[j.index] == p[i.index])
@@ -2824,14 +4270,7 @@ struct graph
 	}
 
 	virtual bool is_floating(petri::iterator n) const {
-		for (int i = 0; i < 2; i++) {
-			for (int j = 0; j < (int)arcs[i].size(); j++) {
-				if (arcs[i][j].from == n || arcs[i][j].to == n) {
-					return false;
-				}
-			}
-		}
-		return true;
+		return outgoing(n.type, n.index).empty() and incoming(n.type, n.index).empty();
 	}
 
 	virtual void set_split_group(int composition, petri::iterator node, split_group g) const {
@@ -2839,6 +4278,8 @@ struct graph
 		if (groups == nullptr) {
 			return;
 		}
+		relations_ready = false;
+		split_pools_ready = false;
 
 		auto pos = lower_bound(groups->begin(), groups->end(), g.split);
 		if (pos != groups->end() and pos->split == g.split) {
@@ -2849,7 +4290,7 @@ struct graph
 	}
 
 	virtual split_group get_split_group(int composition, petri::iterator node, int split) const {
-		vector<split_group> groups = split_groups_of(composition, node, false);
+		span<const split_group> groups = split_groups_view(composition, node, false);
 		auto pos = lower_bound(groups.begin(), groups.end(), split);
 		if (pos != groups.end() and pos->split == split) {
 			return *pos;
@@ -2868,6 +4309,68 @@ struct graph
 		return &transitions[node.index].splits[composition];
 	}
 
+	// The split groups of a node without copying them. The view is valid
+	// until the split groups are next computed or edited.
+	virtual span<const split_group> split_groups_view(int composition, petri::iterator node, bool update = true) const {
+		if (node.index < 0) {
+			if (node.type == transition::type and composition == choice and (int)reset.size() > 1) {
+				if (reset_groups.size() != reset.size()) {
+					update_reset_groups();
+				}
+				if (-node.index-1 < (int)reset_groups.size()) {
+					return span<const split_group>(&reset_groups[-node.index-1], 1);
+				}
+			}
+			return span<const split_group>();
+		}
+
+		if (update and not split_groups_ready and not (split_groups_stale and update_split_groups())) {
+			compute_split_groups();
+		}
+		return *split_groups_iter(composition, node);
+	}
+
+	// The conditional split groups of the reset pseudo-transitions, see
+	// split_groups_of().
+	void update_reset_groups() const {
+		reset_groups.clear();
+		for (int i = 0; i < (int)reset.size(); i++) {
+			reset_groups.push_back(split_group(-1, (int)reset.size(), vector<int>(1, -i-1)));
+			reset_groups.back().set_mask(i);
+		}
+	}
+
+	// Bring the split groups and the pools that index them up to date.
+	// Returns false if the pools are out of date and update is false.
+	bool update_split_pools(bool update = true) const {
+		if (split_pools_ready) {
+			return true;
+		} else if (not update) {
+			return false;
+		}
+
+		if (not split_groups_ready and not (split_groups_stale and update_split_groups())) {
+			compute_split_groups();
+		}
+
+		compare_results.assign(compare_results.size(), ~(uint64_t)0);
+		neighbors_ready = false;
+		neighbors_too_large = false;
+		for (int composition = 0; composition < 2; composition++) {
+			auto groups_of = [this, composition](int type, int index) {
+				return span<const split_group>(*split_groups_iter(composition, petri::iterator(type, index)));
+			};
+			split_pools[composition].clear();
+			for (int type = 0; type < 2; type++) {
+				for (petri::iterator i = begin(type); i != end(type); i = next_node(i)) {
+					split_pools[composition].push(type, i.index, groups_of(type, i.index), groups_of);
+				}
+			}
+		}
+		split_pools_ready = true;
+		return true;
+	}
+
 	virtual vector<split_group> split_groups_of(int composition, petri::iterator node, bool update = true) const {
 		if (node.index < 0) {
 			if (node.type == transition::type and composition == choice and (int)reset.size() > 1) {
@@ -2876,7 +4379,7 @@ struct graph
 			return vector<split_group>();
 		}
 
-		if (update and !split_groups_ready) {
+		if (update and not split_groups_ready and not (split_groups_stale and update_split_groups())) {
 			compute_split_groups();
 		}
  
@@ -2891,13 +4394,304 @@ struct graph
 		if (nodes.empty()) {
 			return groups;
 		}
-		groups = split_groups_of(composition, nodes[0]);
+		span<const split_group> first = split_groups_view(composition, nodes[0]);
+		groups.assign(first.begin(), first.end());
+		vector<split_group> next;
 		for (int i = 1; i < (int)nodes.size(); i++) {
-			groups = petri::merge(group_operation, branch_operation, groups, split_groups_of(composition, nodes[i]));
+			petri::merge(group_operation, branch_operation, groups, split_groups_view(composition, nodes[i]), next);
+			std::swap(groups, next);
 		}
 		return groups;
 	}
 
+	// The base relations kept by the relation cache. The always variants of
+	// the queries below combine two of them.
+	enum {
+		// compare(INTERSECT, SYMMETRIC_DIFFERENCE) of the parallel groups
+		PARALLEL_RELATION = 0,
+		// compare(INTERSECT, NOT_EQUAL) of the conditional groups
+		CHOICE_RELATION = 1,
+		// compare(INTERSECT, SYMMETRIC_DIFFERENCE) of the conditional groups
+		EXCLUSIVE_RELATION = 2,
+		// compare(NEGATIVE_DIFFERENCE, DIFFERENCE) of the conditional groups
+		EXCLUDES_RELATION = 3,
+		// compare(INTERSECT, SUBSET_EQUAL) of both the parallel and the
+		// conditional groups
+		SEQUENCE_RELATION = 4
+	};
+
+	// Choose whether the relation queries below are answered from bit-matrices
+	// computed in one pass over the split groups instead of comparing the
+	// split groups of the two nodes on every query. If the matrices would
+	// take more than budget bytes, the queries compare the split groups as
+	// usual. The matrices are computed by the first query after the split
+	// groups change.
+	void set_relation_cache(bool enable, int64_t budget = 64 << 20) {
+		relation_cache = enable;
+		relation_budget = budget;
+		relations_ready = false;
+		relations_too_large = false;
+		for (int r = 0; r < (int)relations.size(); r++) {
+			relations[r].clear();
+		}
+		relation_class.clear();
+	}
+
+	// Bring the relation cache up to date. Returns false if the relation
+	// queries need to compare the split groups instead.
+	bool update_relations(bool update = true) const {
+		if (not relation_cache or relations_too_large) {
+			return false;
+		} else if (relations_ready) {
+			return true;
+		} else if (not update) {
+			return false;
+		}
+
+		update_split_pools();
+
+		// Number the distinct pairs of split groups, which are the distinct
+		// pairs of pool ids
+		int64_t offset = (int64_t)places.size();
+		int64_t nodes = (int64_t)places.size() + (int64_t)transitions.size();
+		auto node = [offset](int64_t i) {
+			return i < offset ? petri::iterator(place::type, (int)i) : petri::iterator(transition::type, (int)(i - offset));
+		};
+		auto groups = [this](petri::iterator n, int composition) {
+			return split_groups_view(composition, n, false);
+		};
+
+		relation_class.assign(nodes, 0);
+		vector<petri::iterator> classes;
+		unordered_map<uint64_t, int> pairs;
+		for (int64_t i = 0; i < nodes; i++) {
+			petri::iterator n = node(i);
+			uint64_t key = ((uint64_t)(uint32_t)split_pools[parallel].id(n.type, n.index) << 32)
+				| (uint64_t)(uint32_t)split_pools[choice].id(n.type, n.index);
+			auto pos = pairs.insert({key, (int)classes.size()});
+			if (pos.second) {
+				classes.push_back(n);
+			}
+			relation_class[i] = pos.first->second;
+		}
+
+		int count = (int)classes.size();
+		relation_words = (count + 63)/64;
+		if ((int64_t)relations.size()*count*relation_words*8 > relation_budget) {
+			relations_too_large = true;
+			relation_class.clear();
+			return false;
+		}
+		for (int r = 0; r < (int)relations.size(); r++) {
+			relations[r].assign((int64_t)count*relation_words, 0);
+		}
+
+		// Each row is written by one job
+		parallel_for(count, [this, count, &classes, &groups](int thread, int i) {
+			span<const split_group> ap = groups(classes[i], parallel);
+			span<const split_group> ac = groups(classes[i], choice);
+			int64_t row = (int64_t)i*relation_words;
+			for (int j = 0; j < count; j++) {
+				span<const split_group> bp = groups(classes[j], parallel);
+				span<const split_group> bc = groups(classes[j], choice);
+				uint64_t bit = (uint64_t)1 << (j&63);
+				int64_t word = row + (j>>6);
+				if (compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ap, bp)) {
+					relations[PARALLEL_RELATION][word] |= bit;
+				}
+				if (compare(split_group::INTERSECT, split_group::NOT_EQUAL, ac, bc)) {
+					relations[CHOICE_RELATION][word] |= bit;
+				}
+				if (compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ac, bc)) {
+					relations[EXCLUSIVE_RELATION][word] |= bit;
+				}
+				if (compare(split_group::NEGATIVE_DIFFERENCE, split_group::DIFFERENCE, ac, bc)) {
+					relations[EXCLUDES_RELATION][word] |= bit;
+				}
+				if (compare(split_group::INTERSECT, split_group::SUBSET_EQUAL, ap, bp)
+					and compare(split_group::INTERSECT, split_group::SUBSET_EQUAL, ac, bc)) {
+					relations[SEQUENCE_RELATION][word] |= bit;
+				}
+			}
+		});
+
+		relations_ready = true;
+		return true;
+	}
+
+	// Look up a base relation between two nodes in the relation cache, which
+	// must be up to date.
+	bool relation(int r, petri::iterator a, petri::iterator b) const {
+		int64_t offset = (int64_t)places.size();
+		int i = relation_class[offset*a.type + a.index];
+		int j = relation_class[offset*b.type + b.index];
+		return (relations[r][(int64_t)i*relation_words + (j>>6)] >> (j&63)) & 1;
+	}
+
+	// Bring every cache read by the relation queries up to date. After this,
+	// the relation queries only read the graph, so they may run on several
+	// threads at once until the graph is next edited.
+	void update_queries() const {
+		update_split_pools();
+		update_relations();
+	}
+
+	// Choose whether deinterfere() reads the parallel neighborhood of every
+	// node from bitsets computed once per version of the graph instead of
+	// asking is() for every pair of nodes it looks at. If the bitsets would
+	// take more than budget bytes, deinterfere() asks is() as usual.
+	void set_parallel_neighbors(bool enable, int64_t budget = 64 << 20) {
+		parallel_neighbors = enable;
+		neighbor_budget = budget;
+		neighbors_ready = false;
+		neighbors_too_large = false;
+		parallel_to.clear();
+		parallel_from.clear();
+		parallel_live.clear();
+	}
+
+	// Bring the parallel neighborhoods up to date. Returns false if
+	// deinterfere() needs to ask is() instead.
+	bool update_parallel_neighbors(bool update = true) const {
+		if (not parallel_neighbors or not update_split_pools(update) or neighbors_too_large) {
+			return false;
+		} else if (neighbors_ready and neighbor_size[0] == (int)places.size() and neighbor_size[1] == (int)transitions.size()) {
+			return true;
+		} else if (not update) {
+			return false;
+		}
+
+		int64_t offset = (int64_t)places.size();
+		int64_t nodes = (int64_t)places.size() + (int64_t)transitions.size();
+		neighbor_words = (int)((nodes + 63)/64);
+		if (3*nodes*neighbor_words*8 > neighbor_budget) {
+			neighbors_too_large = true;
+			parallel_to.clear();
+			parallel_from.clear();
+			parallel_live.clear();
+			return false;
+		}
+
+		update_queries();
+
+		vector<petri::iterator> live;
+		parallel_live.assign(neighbor_words, 0);
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = begin(type); i != end(type); i = next_node(i)) {
+				live.push_back(i);
+				int64_t k = offset*i.type + i.index;
+				parallel_live[k>>6] |= (uint64_t)1 << (k&63);
+			}
+		}
+
+		// Each row is written by one job
+		parallel_to.assign(nodes*neighbor_words, 0);
+		parallel_for((int)live.size(), [this, offset, &live](int thread, int a) {
+			uint64_t *row = parallel_to.data() + (offset*live[a].type + live[a].index)*neighbor_words;
+			for (auto b = live.begin(); b != live.end(); b++) {
+				if (is(parallel, live[a], *b)) {
+					int64_t k = offset*b->type + b->index;
+					row[k>>6] |= (uint64_t)1 << (k&63);
+				}
+			}
+		});
+
+		parallel_from.assign(nodes*neighbor_words, 0);
+		parallel_for((int)live.size(), [this, offset, nodes, &live](int thread, int b) {
+			int64_t k = offset*live[b].type + live[b].index;
+			uint64_t *row = parallel_from.data() + k*neighbor_words;
+			for (int64_t a = 0; a < nodes; a++) {
+				if ((parallel_to[a*neighbor_words + (k>>6)] >> (k&63)) & 1) {
+					row[a>>6] |= (uint64_t)1 << (a&63);
+				}
+			}
+		});
+
+		neighbor_size[0] = (int)places.size();
+		neighbor_size[1] = (int)transitions.size();
+		neighbors_ready = true;
+		return true;
+	}
+
+	// Choose whether compare_split_groups() remembers its results by the pool
+	// ids of the two nodes, so that nodes with the same split groups as an
+	// earlier query are answered with one lookup. The results are kept in a
+	// table of slots entries, rounded up to a power of two, and a result is
+	// dropped when another one lands in its slot.
+	void set_compare_memo(bool enable, int64_t slots = 1 << 16) {
+		compare_memo = enable;
+		int64_t size = 1;
+		while (enable and size < slots) {
+			size <<= 1;
+		}
+		compare_results.assign(enable ? size : 0, ~(uint64_t)0);
+	}
+
+	// Choose whether compare_split_groups() counts how many comparisons were
+	// answered by the signatures of the two nodes. The counts are shared by
+	// every thread that queries the graph, so they are off by default to keep
+	// the queries free of contention.
+	void set_signature_stats(bool enable) {
+		signature_stats = enable;
+		reset_signature_stats();
+	}
+
+	// The fraction of the comparisons made by compare_split_groups() since the
+	// last reset_signature_stats() that were answered by the signatures of the
+	// two nodes, or 0 if they aren't counted.
+	double signature_hit_rate() const {
+		return signature_queries == 0 ? 0.0 : (double)signature_hits/(double)signature_queries;
+	}
+
+	void reset_signature_stats() const {
+		signature_queries = 0;
+		signature_hits = 0;
+	}
+
+	// Compare the split groups of two nodes. Nodes whose signatures in the
+	// pools show that they share no splits are answered without reading
+	// their groups.
+	bool compare_split_groups(int composition, int group_operation, int branch_operation, petri::iterator a, petri::iterator b, bool update=true) const {
+		if (a.index >= 0 and b.index >= 0 and update_split_pools(update)) {
+			const split_pool &groups = split_pools[composition];
+			int i = groups.id(a.type, a.index);
+			int j = groups.id(b.type, b.index);
+			if (i >= 0 and j >= 0) {
+				// Nodes that share no splits are compared by their signatures
+				bool result;
+				bool hit = (groups.signature[i] & groups.signature[j]) == 0
+					and compare_disjoint(group_operation, branch_operation, groups.partial[i], groups.partial[j], result);
+				if (signature_stats) {
+					std::atomic_ref<int64_t>(signature_queries).fetch_add(1, std::memory_order_relaxed);
+					if (hit) {
+						std::atomic_ref<int64_t>(signature_hits).fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+				if (hit) {
+					return result;
+				}
+			}
+
+			if (not compare_memo or i < 0 or j < 0 or i >= (1 << 28) or j >= (1 << 28)) {
+				return compare(group_operation, branch_operation, split_groups_view(composition, a, false), split_groups_view(composition, b, false));
+			}
+
+			// Each slot is read and written in one piece, so the table may be
+			// shared by several threads.
+			uint64_t key = ((uint64_t)(composition*64 + group_operation*8 + branch_operation) << 56)
+				| ((uint64_t)i << 28) | (uint64_t)j;
+			std::atomic_ref<uint64_t> slot(compare_results[((key * 0x9E3779B97F4A7C15ull) >> 32) & (compare_results.size()-1)]);
+			uint64_t value = slot.load(std::memory_order_relaxed);
+			if ((value & ~((uint64_t)1 << 63)) == key) {
+				return (value >> 63) != 0;
+			}
+			bool result = compare(group_operation, branch_operation, split_groups_view(composition, a, false), split_groups_view(composition, b, false));
+			slot.store(key | ((uint64_t)result << 63), std::memory_order_relaxed);
+			return result;
+		}
+		return compare(group_operation, branch_operation, split_groups_view(composition, a, update), split_groups_view(composition, b, update));
+	}
+
 	// a is sometimes in choice with b if firing a does not imply a firing on b
 	// a is always in choice with b if firing a implies b will not fire
 	// a and b are sometimes in bidirectional choice if firing a does not imply a
@@ -2907,10 +4701,12 @@ struct graph
 			return true;
 		}
 
-		auto ac = split_groups_of(choice, a, update);
-		auto bc = split_groups_of(choice, b, update);
+		if (a.index >= 0 and b.index >= 0 and update_relations(update)) {
+			return relation(EXCLUDES_RELATION, a, b)
+				and (not always or relation(EXCLUSIVE_RELATION, a, b));
+		}
 
-		return compare(split_group::NEGATIVE_DIFFERENCE, split_group::DIFFERENCE, ac, bc)
+		return compare_split_groups(choice, split_group::NEGATIVE_DIFFERENCE, split_group::DIFFERENCE, a, b, update)
 			and (not always or not is_implies(a, b, false, update));
 	}
 
@@ -2924,10 +4720,12 @@ struct graph
 			return true;
 		}
 
-		auto ac = split_groups_of(choice, a, update);
-		auto bc = split_groups_of(choice, b, update);
+		if (a.index >= 0 and b.index >= 0 and update_relations(update)) {
+			return not relation(EXCLUSIVE_RELATION, a, b)
+				and (not always or not relation(EXCLUDES_RELATION, a, b));
+		}
 
-		return not compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ac, bc)
+		return not compare_split_groups(choice, split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, a, b, update)
 			and (not always or not is_excludes(a, b, false, update));
 	}
 
@@ -2940,10 +4738,14 @@ struct graph
 			return false;
 		}
 
-		auto ac = split_groups_of(choice, a, update);
-		auto bc = split_groups_of(choice, b, update);
-		return (not always and compare(split_group::INTERSECT, split_group::NOT_EQUAL, ac, bc))
-			or (always and compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ac, bc)
+		if (a.index >= 0 and b.index >= 0 and update_relations(update)) {
+			return (not always and relation(CHOICE_RELATION, a, b))
+				or (always and relation(EXCLUSIVE_RELATION, a, b)
+					and not relation(PARALLEL_RELATION, a, b));
+		}
+
+		return (not always and compare_split_groups(choice, split_group::INTERSECT, split_group::NOT_EQUAL, a, b, update))
+			or (always and compare_split_groups(choice, split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, a, b, update)
 				and not is_parallel(a, b, false, update));
 	}
 
@@ -2955,9 +4757,12 @@ struct graph
 			return false;
 		}
 
-		auto ap = split_groups_of(parallel, a, update);
-		auto bp = split_groups_of(parallel, b, update);
-		return compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, ap, bp)
+		if (a.index >= 0 and b.index >= 0 and update_relations(update)) {
+			return relation(PARALLEL_RELATION, a, b)
+				and (not always or not relation(CHOICE_RELATION, a, b));
+		}
+
+		return compare_split_groups(parallel, split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, a, b, update)
 			 and (not always or not is_choice(a, b, false, update));
 	}
 
@@ -2966,13 +4771,13 @@ struct graph
 			return false;
 		}
 
-		auto ap = split_groups_of(parallel, a, update);
-		auto bp = split_groups_of(parallel, b, update);
-		auto ac = split_groups_of(choice, a, update);
-		auto bc = split_groups_of(choice, b, update);
+		if (a.index >= 0 and b.index >= 0 and update_relations(update)) {
+			return relation(SEQUENCE_RELATION, a, b)
+				and (not always or not relation(CHOICE_RELATION, a, b));
+		}
 
-		return compare(split_group::INTERSECT, split_group::SUBSET_EQUAL, ap, bp)
-			and compare(split_group::INTERSECT, split_group::SUBSET_EQUAL, ac, bc)
+		return compare_split_groups(parallel, split_group::INTERSECT, split_group::SUBSET_EQUAL, a, b, update)
+			and compare_split_groups(choice, split_group::INTERSECT, split_group::SUBSET_EQUAL, a, b, update)
 			and (not always or not is_choice(a, b, false, update));
 	}
 
@@ -3149,9 +4954,13 @@ struct graph
 	virtual vector<array<vector<petri::iterator>, 2> > deinterfere(vector<petri::iterator> v0, vector<petri::iterator> v1) {
 		sort(v0.begin(), v0.end());
 		sort(v1.begin(), v1.end());
+		if (update_parallel_neighbors()) {
+			return deinterfere_neighbors(v0, v1);
+		}
+
 		vector<petri::iterator> v0p, v1p;
 		for (int j = 0; j < 2; j++) {
-			for (auto i = begin(j); i != end(j); i++) {
+			for (auto i = begin(j); i != end(j); i = next_node(i)) {
 				if (find(v1.begin(), v1.end(), i) == v1.end() and is(parallel, vector<petri::iterator>(1, i), v0)) {
 					v0p.push_back(i);
 				}
@@ -3198,6 +5007,96 @@ struct graph
 		return result;
 	}
 
+	// deinterfere() for sorted v0 and v1 with the parallel neighborhoods,
+	// which must be up to date. The nodes that are in parallel with all of v0
+	// or v1 are intersections of rows of parallel_from, and the pairs of
+	// nodes that aren't in parallel are found a word at a time.
+	vector<array<vector<petri::iterator>, 2> > deinterfere_neighbors(const vector<petri::iterator> &v0, const vector<petri::iterator> &v1) const {
+		int64_t offset = (int64_t)places.size();
+		int words = neighbor_words;
+		auto id = [offset](petri::iterator n) {
+			return offset*n.type + n.index;
+		};
+		auto node = [offset](int64_t k) {
+			return k < offset ? petri::iterator(place::type, (int)k) : petri::iterator(transition::type, (int)(k - offset));
+		};
+		auto bits_of = [words, &id](const vector<petri::iterator> &v) {
+			vector<uint64_t> result(words, 0);
+			for (auto i = v.begin(); i != v.end(); i++) {
+				result[id(*i)>>6] |= (uint64_t)1 << (id(*i)&63);
+			}
+			return result;
+		};
+		// The nodes that are in parallel with every node of v other than
+		// themselves
+		auto common_of = [this, words, &id](const vector<petri::iterator> &v) {
+			vector<uint64_t> result = parallel_live;
+			for (auto i = v.begin(); i != v.end(); i++) {
+				const uint64_t *row = parallel_from.data() + id(*i)*words;
+				for (int w = 0; w < words; w++) {
+					result[w] &= row[w] | (w == (id(*i)>>6) ? (uint64_t)1 << (id(*i)&63) : 0);
+				}
+			}
+			return result;
+		};
+
+		vector<array<vector<petri::iterator>, 2> > result;
+		vector<uint64_t> b0 = bits_of(v0), b1 = bits_of(v1);
+		vector<uint64_t> c0 = common_of(v0), c1 = common_of(v1);
+		bool parallel_to_v1 = true;
+		for (int w = 0; w < words; w++) {
+			if (b0[w] & b1[w]) {
+				return result;
+			}
+			parallel_to_v1 = parallel_to_v1 and (b0[w] & ~c1[w]) == 0;
+		}
+
+		if (not parallel_to_v1) {
+			result.push_back({v0, v1});
+			return result;
+		}
+
+		vector<uint64_t> v0p(words), v1p(words);
+		for (int w = 0; w < words; w++) {
+			v0p[w] = c0[w] & ~b1[w];
+			v1p[w] = c1[w] & ~b0[w];
+		}
+
+		for (int w = 0; w < words; w++) {
+			for (uint64_t bits = v0p[w] & ~c1[w]; bits != 0; bits &= bits-1) {
+				result.push_back({v0, v1});
+				result.back()[0].push_back(node(w*64 + std::countr_zero(bits)));
+			}
+		}
+
+		for (int w = 0; w < words; w++) {
+			for (uint64_t bits = v1p[w] & ~c0[w]; bits != 0; bits &= bits-1) {
+				result.push_back({v0, v1});
+				result.back()[1].push_back(node(w*64 + std::countr_zero(bits)));
+			}
+		}
+
+		for (int w = 0; w < words; w++) {
+			for (uint64_t bits = v0p[w]; bits != 0; bits &= bits-1) {
+				int64_t i = w*64 + std::countr_zero(bits);
+				const uint64_t *row = parallel_to.data() + i*words;
+				for (int x = 0; x < words; x++) {
+					uint64_t pairs = v1p[x] & ~row[x];
+					if (x == w) {
+						pairs &= ~((uint64_t)1 << (i&63));
+					}
+					for (; pairs != 0; pairs &= pairs-1) {
+						result.push_back({v0, v1});
+						result.back()[0].push_back(node(i));
+						result.back()[1].push_back(node(x*64 + std::countr_zero(pairs)));
+					}
+				}
+			}
+		}
+
+		return result;
+	}
+
 	// select groups nodes into maximal cliques based on specific relationship types
 	//
 	// Nodes can be simultaneously composed in both parallel and conditional.
@@ -3236,17 +5135,51 @@ struct graph
 		//                     and choice relations.
 		//  always &  invert - separate nodes that are always composed as the opposite of requested
 
-		vector<vector<petri::iterator> > result;
-
 		// This is the problem of identifying all maximal cliques in the
 		// graph constructed using the nodes in "from" as vertices and
 		// creating edges between each pair of parallel nodes. This is an
 		// NP-complete problem and we are solving it using the Bron–Kerbosch
-		// algorithm.
-		struct BronKerboschFrame {
-			vector<petri::iterator> R, P, X;
-		};
+		// algorithm, see maximal_cliques(). The search is split over the
+		// thread pool, and the result does not depend on the number of
+		// threads.
+		clique_graph edges = select_edges(composition, nodes, always, invert);
+
+		vector<vector<petri::iterator> > result;
+		vector<vector<int> > cliques = maximal_cliques(edges, pool.get());
+		for (auto clique = cliques.begin(); clique != cliques.end(); clique++) {
+			result.push_back(vector<petri::iterator>());
+			for (auto i = clique->begin(); i != clique->end(); i++) {
+				result.back().push_back(nodes[*i]);
+			}
+			sort(result.back().begin(), result.back().end());
+		}
+
+		return result;
+	}
 
+	// Like select(), but calls visit with each clique as soon as it is found
+	// instead of collecting all of them. The cliques are found on the calling
+	// thread in no particular order. The search stops as soon as visit
+	// returns false or one of the limits is reached, see clique_limits, but
+	// the relation between every pair of nodes is always computed first.
+	// Returns true if every clique within the limits was visited.
+	virtual bool select_each(int composition, vector<petri::iterator> nodes, const function<bool(const vector<petri::iterator>&)> &visit, bool always=false, bool invert=false, clique_limits limits=clique_limits()) {
+		clique_graph edges = select_edges(composition, nodes, always, invert);
+
+		vector<petri::iterator> clique;
+		return maximal_cliques(edges, [&nodes, &visit, &clique](const vector<int> &found) {
+			clique.clear();
+			for (auto i = found.begin(); i != found.end(); i++) {
+				clique.push_back(nodes[*i]);
+			}
+			sort(clique.begin(), clique.end());
+			return visit(clique);
+		}, limits);
+	}
+
+	// The composition that select() and group() compare against when invert
+	// is set
+	static int opposite_of(int composition) {
 		int opposite = composition;
 		if (composition == parallel) {
 			opposite = choice;
@@ -3258,45 +5191,45 @@ struct graph
 			opposite = implies;
 		}
 
-		vector<BronKerboschFrame> frames;
-		frames.push_back(BronKerboschFrame());
-		frames.back().P = nodes;
-
-		while (not frames.empty()) {
-			auto frame = frames.back();
-			frames.pop_back();
-
-			if (frame.P.empty() and frame.X.empty()) {
-				// Then we've found a maximal clique
-				sort(frame.R.begin(), frame.R.end());
-				result.push_back(frame.R);
-			} else {
-				// Otherwise, we need to recurse
-				while (not frame.P.empty()) {
-					frames.push_back(frame);
-					frames.back().R.push_back(frame.P.back());
-					for (int i = (int)frames.back().P.size()-1; i >= 0; i--) {
-						if (frames.back().P[i] == frame.P.back()
-							or (not invert and not is(composition, frames.back().P[i], frame.P.back(), always, true))
-							or (invert and is(opposite, frames.back().P[i], frame.P.back(), always, true))) {
-							frames.back().P.erase(frames.back().P.begin() + i);
-						}
-					}
-					for (int i = (int)frames.back().X.size()-1; i >= 0; i--) {
-						if (frames.back().X[i] == frame.P.back()
-							or (not invert and not is(composition, frames.back().X[i], frame.P.back(), always, true))
-							or (invert and is(opposite, frames.back().X[i], frame.P.back(), always, true))) {
-							frames.back().X.erase(frames.back().X.begin() + i);
-						}
-					}
+		return opposite;
+	}
 
-					frame.X.push_back(frame.P.back());
-					frame.P.pop_back();
+	// The edges between the nodes that select() searches for cliques. Each
+	// row is filled in by one job on the thread pool, which is why the
+	// relation caches are brought up to date first.
+	clique_graph select_edges(int composition, const vector<petri::iterator> &nodes, bool always, bool invert) const {
+		int opposite = opposite_of(composition);
+		update_queries();
+		clique_graph edges((int)nodes.size());
+		parallel_for((int)nodes.size(), [this, &nodes, &edges, composition, opposite, always, invert](int thread, int i) {
+			for (int j = 0; j < (int)nodes.size(); j++) {
+				if (nodes[i] != nodes[j]
+					and ((not invert and is(composition, nodes[j], nodes[i], always, true))
+						or (invert and not is(opposite, nodes[j], nodes[i], always, true)))) {
+					edges.connect(i, j);
 				}
 			}
-		}
-
-		return result;
+		});
+		return edges;
+	}
+
+	// The edges between the groups of nodes that group() searches for
+	// cliques, like select_edges()
+	clique_graph group_edges(int composition, const vector<vector<petri::iterator> > &nodes, bool always, bool invert) const {
+		int opposite = opposite_of(composition);
+		update_queries();
+		int count = (int)nodes.size();
+		clique_graph edges(count);
+		parallel_for(count, [this, &nodes, &edges, count, composition, opposite, always, invert](int thread, int i) {
+			for (int j = 0; j < count; j++) {
+				if (i != j
+					and ((not invert and is(composition, nodes[j], nodes[i], always))
+						or (invert and not is(opposite, nodes[j], nodes[i], always)))) {
+					edges.connect(i, j);
+				}
+			}
+		});
+		return edges;
 	}
 
 	// Takes a strict selection of nodes (see graph::select() ) and regroups them into all non-strict selections
@@ -3306,69 +5239,43 @@ struct graph
 		//  always & ~invert - group nodes that are always composed as requested.
 		//  always &  invert - group nodes that aren't always composed as the opposite of requested
 
-		struct BronKerboschFrame {
-			vector<int> R, P, X;
-		};
-
-		int opposite = composition;
-		if (composition == parallel) {
-			opposite = choice;
-		} else if (composition == choice) {
-			opposite = parallel;
-		} else if (composition == implies) {
-			opposite = excludes;
-		} else if (composition == excludes) {
-			opposite = implies;
-		}
-
-		vector<BronKerboschFrame> frames;
-		frames.push_back(BronKerboschFrame());
-		for (int i = 0; i < (int)nodes.size(); i++) {
-			frames.back().P.push_back(i);
-		}
-
-		while (not frames.empty()) {
-			auto frame = frames.back();
-			frames.pop_back();
-
-			if (frame.P.empty() and frame.X.empty()) {
-				// Then we've found a maximal clique
-				if ((int)frame.R.size() > 1) {
-					nodes.push_back(vector<petri::iterator>());
-					for (auto i = frame.R.begin(); i != frame.R.end(); i++) {
-						nodes.back().insert(nodes.back().end(), nodes[*i].begin(), nodes[*i].end());
-					}
-					sort(nodes.back().begin(), nodes.back().end());
-				}
-			} else {
-				// Otherwise, we need to recurse
-				while (not frame.P.empty()) {
-					frames.push_back(frame);
-					frames.back().R.push_back(frame.P.back());
-					for (int i = (int)frames.back().P.size()-1; i >= 0; i--) {
-						if (frames.back().P[i] == frame.P.back()
-							or (not invert and not is(composition, nodes[frames.back().P[i]], nodes[frame.P.back()], always))
-							or (invert and is(opposite, nodes[frames.back().P[i]], nodes[frame.P.back()], always))) {
-							frames.back().P.erase(frames.back().P.begin() + i);
-						}
-					}
-					for (int i = (int)frames.back().X.size()-1; i >= 0; i--) {
-						if (frames.back().X[i] == frame.P.back()
-							or (not invert and not is(composition, nodes[frames.back().X[i]], nodes[frame.P.back()], always))
-							or (invert and is(opposite, nodes[frames.back().X[i]], nodes[frame.P.back()], always))) {
-							frames.back().X.erase(frames.back().X.begin() + i);
-						}
-					}
+		// Like select(), this may run on the thread pool
+		clique_graph edges = group_edges(composition, nodes, always, invert);
 
-					frame.X.push_back(frame.P.back());
-					frame.P.pop_back();
+		vector<vector<int> > cliques = maximal_cliques(edges, pool.get());
+		for (auto clique = cliques.begin(); clique != cliques.end(); clique++) {
+			if ((int)clique->size() > 1) {
+				nodes.push_back(vector<petri::iterator>());
+				for (auto i = clique->begin(); i != clique->end(); i++) {
+					nodes.back().insert(nodes.back().end(), nodes[*i].begin(), nodes[*i].end());
 				}
+				sort(nodes.back().begin(), nodes.back().end());
 			}
 		}
 
 		return nodes;
 	}
 
+	// Like group(), but calls visit with each new group as soon as it is found,
+	// see select_each(). Returns true if every group within the limits was
+	// visited.
+	bool group_each(int composition, const vector<vector<petri::iterator> > &nodes, const function<bool(const vector<petri::iterator>&)> &visit, bool always=false, bool invert=false, clique_limits limits=clique_limits()) {
+		clique_graph edges = group_edges(composition, nodes, always, invert);
+
+		vector<petri::iterator> merged;
+		return maximal_cliques(edges, [&nodes, &visit, &merged](const vector<int> &found) {
+			if ((int)found.size() <= 1) {
+				return true;
+			}
+			merged.clear();
+			for (auto i = found.begin(); i != found.end(); i++) {
+				merged.insert(merged.end(), nodes[*i].begin(), nodes[*i].end());
+			}
+			sort(merged.begin(), merged.end());
+			return visit(merged);
+		}, limits);
+	}
+
 	vector<vector<petri::iterator> > complete(int composition, vector<vector<petri::iterator> > nodes) {
 		// In this function, we are given conditional groups of parallel
 		// nodes. In some cases, one group may entirely overlap another.
@@ -3464,12 +5371,12 @@ struct graph
 		nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
 
 		if (other.empty()) {
-			for (auto i = begin(place::type); i != end(place::type); i++) {
+			for (auto i = begin(place::type); i != end(place::type); i = next_node(i)) {
 				if (is(composition, vector<petri::iterator>(1, i), nodes)) {
 					other.push_back(i);
 				}
 			}
-			for (auto i = begin(transition::type); i != end(transition::type); i++) {
+			for (auto i = begin(transition::type); i != end(transition::type); i = next_node(i)) {
 				if (is(composition, vector<petri::iterator>(1, i), nodes)) {
 					other.push_back(i);
 				}
@@ -3478,28 +5385,57 @@ struct graph
 
 		// Given the set of nodes in "other" and the set of nodes in "nodes", we
 		// need to find all cliques (maximal or not) in the graph created by
-		// the requested composition relations.
+		// the requested composition relations. This is a breadth first search
+		// one level per clique size, where each clique is kept as a bitset over
+		// "other". Every clique of a level is extended on the thread pool, and
+		// the set of cliques found so far tells which extensions are new.
+		int words = ((int)other.size()+63)/64;
+		update_queries();
+
+		clique_set found;
+		vector<vector<uint64_t> > level(1, vector<uint64_t>(words, 0));
+		found.insert(level[0]);
+
 		vector<vector<petri::iterator> > result;
-		list<pair<vector<petri::iterator>, vector<petri::iterator> > > queue;
-		queue.push_back(pair<vector<petri::iterator>, vector<petri::iterator> >(nodes, other));
-		while (not queue.empty()) {
-			auto curr = queue.front();
-			queue.pop_front();
-
-			auto k = lower_bound(result.begin(), result.end(), curr.first);
-			if (k == result.end() or *k != curr.first) {
-				result.insert(k, curr.first);
-				for (auto i = curr.second.begin(); i != curr.second.end(); i++) {
-					if (is(composition, vector<petri::iterator>(1, *i), curr.first)) {
-						queue.push_back(curr);
-						auto j = lower_bound(queue.back().first.begin(), queue.back().first.end(), *i);
-						queue.back().first.insert(j, *i);
-						queue.back().second.erase(queue.back().second.begin() + (i-curr.second.begin()));
+		vector<vector<vector<uint64_t> > > next(threads());
+		while (not level.empty()) {
+			for (auto clique = level.begin(); clique != level.end(); clique++) {
+				result.push_back(nodes);
+				for (int i = 0; i < (int)other.size(); i++) {
+					if ((*clique)[i>>6] & ((uint64_t)1 << (i&63))) {
+						result.back().push_back(other[i]);
+					}
+				}
+				sort(result.back().begin(), result.back().end());
+			}
+
+			int first = (int)result.size() - (int)level.size();
+			parallel_for((int)level.size(), [this, composition, &other, &level, &result, &found, &next, first](int thread, int k) {
+				const vector<uint64_t> &clique = level[k];
+				vector<uint64_t> extended;
+				for (int i = 0; i < (int)other.size(); i++) {
+					uint64_t bit = (uint64_t)1 << (i&63);
+					if ((clique[i>>6] & bit) == 0
+						and is(composition, vector<petri::iterator>(1, other[i]), result[first+k])) {
+						extended = clique;
+						extended[i>>6] |= bit;
+						if (found.insert(extended)) {
+							next[thread].push_back(std::move(extended));
+						}
 					}
 				}
+			});
+
+			level.clear();
+			for (auto n = next.begin(); n != next.end(); n++) {
+				level.insert(level.end(), std::make_move_iterator(n->begin()), std::make_move_iterator(n->end()));
+				n->clear();
 			}
 		}
 
+		// Positions of "other" that hold the same node give the same partial
+		sort(result.begin(), result.end());
+		result.erase(unique(result.begin(), result.end()), result.end());
 		return result;
 	}
 
@@ -3563,7 +5499,7 @@ struct graph
 	}
 
 	virtual bool is_redundant(petri::iterator p0) {
-		for (auto i = begin(place::type); i != end(place::type); i++) {
+		for (auto i = begin(place::type); i != end(place::type); i = next_node(i)) {
 			if (is_redundant_to(p0, i)) {
 				//cout << p0 << " is redundant to " << i << endl;
 				return true;
@@ -3573,7 +5509,7 @@ struct graph
 	}
 
 	virtual vector<petri::iterator> add_redundant(vector<petri::iterator> p) {
-		for (auto i = begin(place::type); i != end(place::type); i++) {
+		for (auto i = begin(place::type); i != end(place::type); i = next_node(i)) {
 			if (is_redundant_to(i, p)) {
 				p.push_back(i);
 			}
@@ -3584,7 +5520,7 @@ struct graph
 	}
 
 	virtual void erase_redundant() {
-		for (auto i = rbegin(place::type); i != rend(place::type); i--) {
+		for (auto i = rbegin(place::type); i != rend(place::type); i = prev_node(i)) {
 			if (is_redundant(i)) {
 				//erase(i);
 			}
@@ -3633,6 +5569,17 @@ struct graph
 					branches.push_back(n[j].index);
 				}
 			}
+			if (groups[i].has_mask()) {
+				// the mask is over the same positions, so flip them
+				for (int w = 0; w < (int)groups[i].mask.size(); w++) {
+					groups[i].mask[w] = ~groups[i].mask[w];
+				}
+				if (groups[i].count%64 != 0) {
+					groups[i].mask.back() &= ((uint64_t)1 << (groups[i].count%64)) - 1;
+				}
+			} else {
+				groups[i].mask.clear();
+			}
 			groups[i].branch.swap(branches);
 			branches.clear();
 		}
@@ -1,6 +1,7 @@
 #include "node.h"
 #include <common/message.h>
 #include <common/text.h>
+#include <bit>
 #include <limits>
 
 namespace petri
@@ -19,6 +20,59 @@ split_group::split_group(int split, int count, vector<int> branch) {
 
 split_group::~split_group() {}
 
+// The mask is only used while it holds exactly one bit per branch, so a
+// mask that was left behind by an edit to branch is ignored.
+bool split_group::has_mask() const {
+	if (mask.empty() or (int)mask.size() != (count+63)/64) {
+		return false;
+	}
+	int bits = 0;
+	for (int w = 0; w < (int)mask.size(); w++) {
+		bits += std::popcount(mask[w]);
+	}
+	return bits == (int)branch.size();
+}
+
+void split_group::set_mask(int position) {
+	if (mask.empty()) {
+		mask.assign((count+63)/64, 0);
+	}
+	mask[position>>6] |= (uint64_t)1 << (position&63);
+}
+
+// Sets found0 if a has a bit that b doesn't, found1 if b has a bit that a
+// doesn't and found2 if they share a bit, one word at a time.
+static void compare_masks(span<const uint64_t> a, span<const uint64_t> b, bool &found0, bool &found1, bool &found2) {
+	uint64_t only0 = 0, only1 = 0, both = 0;
+	for (int w = 0; w < (int)a.size(); w++) {
+		only0 |= a[w] & ~b[w];
+		only1 |= b[w] & ~a[w];
+		both |= a[w] & b[w];
+	}
+	found0 = only0 != 0;
+	found1 = only1 != 0;
+	found2 = both != 0;
+}
+
+// Combines the masks of two groups of the same split, or clears the result
+// if either group has no mask.
+static void merge_masks(int branch_operation, const split_group &g0, const split_group &g1, vector<uint64_t> &result) {
+	if (not g0.has_mask() or not g1.has_mask()) {
+		result.clear();
+		return;
+	}
+	result.resize(g0.mask.size());
+	for (int w = 0; w < (int)result.size(); w++) {
+		if (branch_operation == split_group::INTERSECT) {
+			result[w] = g0.mask[w] & g1.mask[w];
+		} else if (branch_operation == split_group::UNION) {
+			result[w] = g0.mask[w] | g1.mask[w];
+		} else {
+			result[w] = g0.mask[w] & ~g1.mask[w];
+		}
+	}
+}
+
 string split_group::to_string() const {
 	return "(" + ::to_string(split) + "," + ::to_string(branch) + "/" + ::to_string(count) + ")";
 }
@@ -59,7 +113,105 @@ ostream &operator<<(ostream &os, const split_group &g0) {
 	return os;
 }
 
-bool compare(int group_operation, int branch_operation, vector<split_group> g0, vector<split_group> g1) {
+split_pool::split_pool() {
+	clear();
+}
+split_pool::~split_pool() {}
+
+void split_pool::clear() {
+	for (int type = 0; type < 2; type++) {
+		ids[type].clear();
+	}
+	owner.clear();
+	signature.clear();
+	partial.clear();
+	index.clear();
+}
+
+// Two lists of groups are the same entry if they agree on everything but the
+// masks, which are only a faster way to read the branches.
+static bool same_groups(span<const split_group> g0, span<const split_group> g1) {
+	if (g0.size() != g1.size()) {
+		return false;
+	}
+	for (int k = 0; k < (int)g0.size(); k++) {
+		if (g0[k].split != g1[k].split
+			or g0[k].count != g1[k].count
+			or g0[k].branch != g1[k].branch) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int split_pool::push(int type, int index, span<const split_group> groups, function<span<const split_group>(int, int)> groups_of) {
+	if (index >= (int)ids[type].size()) {
+		ids[type].resize(index+1, -1);
+	}
+
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](uint64_t value) {
+		hash = (hash ^ value) * 1099511628211ull;
+	};
+	mix(groups.size());
+	for (auto g = groups.begin(); g != groups.end(); g++) {
+		mix((uint64_t)(uint32_t)g->split);
+		mix((uint64_t)(uint32_t)g->count);
+		mix(g->branch.size());
+		for (auto b = g->branch.begin(); b != g->branch.end(); b++) {
+			mix((uint64_t)(uint32_t)*b);
+		}
+	}
+
+	auto range = this->index.equal_range(hash);
+	for (auto i = range.first; i != range.second; i++) {
+		if (same_groups(groups, groups_of(owner[i->second].first, owner[i->second].second))) {
+			ids[type][index] = i->second;
+			return i->second;
+		}
+	}
+
+	uint64_t bits = 0;
+	bool missing = false;
+	for (auto g = groups.begin(); g != groups.end(); g++) {
+		bits |= signature_of(g->split);
+		missing = missing or (int)g->branch.size() < g->count;
+	}
+	owner.push_back(pair<int, int>(type, index));
+	signature.push_back(bits);
+	partial.push_back(missing);
+
+	int result = entries()-1;
+	this->index.insert({hash, result});
+	ids[type][index] = result;
+	return result;
+}
+
+int split_pool::id(int type, int index) const {
+	if (index < 0 or index >= (int)ids[type].size()) {
+		return -1;
+	}
+	return ids[type][index];
+}
+
+int split_pool::entries() const {
+	return (int)owner.size();
+}
+
+uint64_t split_pool::signature_of(int split) {
+	return (uint64_t)1 << (((uint64_t)(uint32_t)split * 0x9E3779B97F4A7C15ull) >> 58);
+}
+
+int64_t split_pool::memory() const {
+	return (int64_t)(ids[0].capacity() + ids[1].capacity())*sizeof(int)
+		+ (int64_t)owner.capacity()*sizeof(pair<int, int>)
+		+ (int64_t)signature.capacity()*sizeof(uint64_t)
+		+ (int64_t)partial.capacity()/8
+		+ (int64_t)index.bucket_count()*sizeof(void*)
+		+ (int64_t)index.size()*(sizeof(pair<uint64_t, int>) + 2*sizeof(void*));
+}
+
+bool compare(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1) {
 	// group_operation is one of:
 	// split_group::INTERSECT
 	// split_group::DIFFERENCE
@@ -82,22 +234,26 @@ bool compare(int group_operation, int branch_operation, vector<split_group> g0,
 				bool found0 = false;
 				bool found1 = false;
 				bool found2 = false;
-				int k = 0, l = 0;
-				while (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size()) {
-					if (g0[i].branch[k] == g1[j].branch[l]) {
-						found2 = true;
-						k++;
-						l++;
-					} else if (g0[i].branch[k] < g1[j].branch[l]) {
-						found0 = true;
-						k++;
-					} else {
-						found1 = true;
-						l++;
+				if (g0[i].count == g1[j].count and g0[i].has_mask() and g1[j].has_mask()) {
+					compare_masks(g0[i].mask, g1[j].mask, found0, found1, found2);
+				} else {
+					int k = 0, l = 0;
+					while (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size()) {
+						if (g0[i].branch[k] == g1[j].branch[l]) {
+							found2 = true;
+							k++;
+							l++;
+						} else if (g0[i].branch[k] < g1[j].branch[l]) {
+							found0 = true;
+							k++;
+						} else {
+							found1 = true;
+							l++;
+						}
 					}
+					found0 = found0 or (k < (int)g0[i].branch.size());
+					found1 = found1 or (l < (int)g1[j].branch.size());
 				}
-				found0 = found0 or (k < (int)g0[i].branch.size());
-				found1 = found1 or (l < (int)g1[j].branch.size());
 				if ((branch_operation == split_group::SYMMETRIC_DIFFERENCE and found0 and found1)
 					or (branch_operation == split_group::INTERSECT and found2)) {
 					return true;
@@ -166,6 +322,23 @@ bool compare(int group_operation, int branch_operation, vector<split_group> g0,
 				or (branch_operation == split_group::SUBSET and branch_cmp != -1)));
 }
 
+bool compare_disjoint(int group_operation, int branch_operation, bool partial0, bool partial1, bool &result) {
+	// Without a shared split, compare() only looks at whether the groups of
+	// each side are missing a branch.
+	if (group_operation == split_group::INTERSECT) {
+		result = branch_operation == split_group::SUBSET_EQUAL;
+	} else if (group_operation == split_group::DIFFERENCE) {
+		result = partial0;
+	} else if (group_operation == split_group::NEGATIVE_DIFFERENCE) {
+		result = partial1;
+	} else if (group_operation == split_group::SYMMETRIC_DIFFERENCE) {
+		result = partial0 or partial1;
+	} else {
+		return false;
+	}
+	return true;
+}
+
 // What operations do I need to do?
 //
 // 1. Determine composition of partial states.
@@ -177,7 +350,16 @@ bool compare(int group_operation, int branch_operation, vector<split_group> g0,
 // Is there a data-structure difference between the always-/every- and the
 // sometimes-/any- preconditioned questions? What kind of considerations do I
 // need for operations between those two types of split groups?
-vector<split_group> merge(int group_operation, int branch_operation, vector<split_group> g0, vector<split_group> g1) {
+vector<split_group> merge(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1) {
+	vector<split_group> result;
+	merge(group_operation, branch_operation, g0, g1, result);
+	return result;
+}
+
+// Writes the merge into result, reusing its groups and their branch vectors
+// so that repeated merges into the same buffer do not allocate. result must
+// not alias g0 or g1.
+void merge(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1, vector<split_group> &result) {
 	// group_operation is one of:
 	// split_group::INTERSECT
 	// split_group::UNION
@@ -186,31 +368,44 @@ vector<split_group> merge(int group_operation, int branch_operation, vector<spli
 	// split_group::INTERSECT
 	// split_group::UNION
 	// split_group::DIFFERENCE
-	
-	vector<split_group> result;
+
+	int n = 0;
+	auto push = [&result, &n]() -> split_group& {
+		if (n == (int)result.size()) {
+			result.push_back(split_group());
+		}
+		return result[n++];
+	};
+
 	int i = 0, j = 0;
 	while (i < (int)g0.size() or j < (int)g1.size()) {
 		if (i < (int)g0.size() and j < (int)g1.size() and g0[i].split == g1[j].split) {
-			result.push_back(split_group());
-			result.back().split = g0[i].split;
-			result.back().count = g0[i].count;
+			split_group &group = push();
+			group.split = g0[i].split;
+			group.count = g0[i].count;
+			group.branch.clear();
+			if (g0[i].count == g1[j].count) {
+				merge_masks(branch_operation, g0[i], g1[j], group.mask);
+			} else {
+				group.mask.clear();
+			}
 
 			int k = 0, l = 0;
 			while (k < (int)g0[i].branch.size() or l < (int)g1[j].branch.size()) {
 				if (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size() and g0[i].branch[k] == g1[j].branch[l]) {
 					if (branch_operation != split_group::DIFFERENCE) {
-						result.back().branch.push_back(g0[i].branch[k]);
+						group.branch.push_back(g0[i].branch[k]);
 					}
 					k++;
 					l++;
 				} else if (k < (int)g0[i].branch.size() and (l >= (int)g1[j].branch.size() or g0[i].branch[k] < g1[j].branch[l])) {
 					if (branch_operation != split_group::INTERSECT) {
-						result.back().branch.push_back(g0[i].branch[k]);
+						group.branch.push_back(g0[i].branch[k]);
 					}
 					k++;
 				} else if (l < (int)g1[j].branch.size()) {
 					if (branch_operation == split_group::UNION) {
-						result.back().branch.push_back(g1[j].branch[l]);
+						group.branch.push_back(g1[j].branch[l]);
 					}
 					l++;
 				}
@@ -219,20 +414,33 @@ vector<split_group> merge(int group_operation, int branch_operation, vector<spli
 			j++;
 		} else if (i < (int)g0.size() and (j >= (int)g1.size() or g0[i].split < g1[j].split)) {
 			if (group_operation != split_group::INTERSECT) {
-				result.push_back(g0[i]);
+				split_group &group = push();
+				group.split = g0[i].split;
+				group.count = g0[i].count;
+				group.branch.assign(g0[i].branch.begin(), g0[i].branch.end());
+				group.mask.assign(g0[i].mask.begin(), g0[i].mask.end());
 			}
 			i++;
 		} else if (j < (int)g1.size()) {
 			if (group_operation == split_group::UNION) {
-				result.push_back(g1[j]);
+				split_group &group = push();
+				group.split = g1[j].split;
+				group.count = g1[j].count;
+				group.branch.assign(g1[j].branch.begin(), g1[j].branch.end());
+				group.mask.assign(g1[j].mask.begin(), g1[j].mask.end());
 			}
 			j++;
 		}
 	}
-	return result;
+	result.resize(n);
 }
 
-void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, const vector<split_group> &g1, set<int> exclude) {
+// Merges g1 into g0, skipping the groups of g1 whose split is in exclude,
+// which must be sorted. The result is built in scratch in one pass over both
+// and then swapped into g0, so scratch keeps the old groups of g0 to be reused
+// by the next merge. g1 must not alias g0. Unlike merge(), DIFFERENCE leaves
+// the branches of g0 as they are.
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, span<const int> exclude, vector<split_group> &scratch) {
 	// group_operation is one of:
 	// split_group::INTERSECT
 	// split_group::UNION
@@ -241,49 +449,94 @@ void merge_inplace(int group_operation, int branch_operation, vector<split_group
 	// split_group::INTERSECT
 	// split_group::UNION
 	// split_group::DIFFERENCE
-	
-	int i = 0, j = 0;
+
+	int n = 0;
+	auto push = [&scratch, &n]() -> split_group& {
+		if (n == (int)scratch.size()) {
+			scratch.push_back(split_group());
+		}
+		return scratch[n++];
+	};
+
+	int i = 0, j = 0, e = 0;
 	while (i < (int)g0.size() or j < (int)g1.size()) {
-		while (j < (int)g1.size() and exclude.find(g1[j].split) != exclude.end()) {
-			j++;
+		while (j < (int)g1.size()) {
+			while (e < (int)exclude.size() and exclude[e] < g1[j].split) {
+				e++;
+			}
+			if (e < (int)exclude.size() and exclude[e] == g1[j].split) {
+				j++;
+			} else {
+				break;
+			}
 		}
 
 		if (i < (int)g0.size() and j < (int)g1.size() and g0[i].split == g1[j].split) {
-			int k = 0, l = 0;
-			while (k < (int)g0[i].branch.size() or l < (int)g1[j].branch.size()) {
-				if (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size() and g0[i].branch[k] == g1[j].branch[l]) {
-					k++;
-					l++;
-				} else if (k < (int)g0[i].branch.size() and (l >= (int)g1[j].branch.size() or g0[i].branch[k] < g1[j].branch[l])) {
-					if (branch_operation == split_group::INTERSECT) {
-						g0[i].branch.erase(g0[i].branch.begin()+k);
-					} else {
+			split_group &group = push();
+			group.split = g0[i].split;
+			group.count = g0[i].count;
+			if (branch_operation == split_group::INTERSECT or branch_operation == split_group::UNION) {
+				if (g0[i].count == g1[j].count) {
+					merge_masks(branch_operation, g0[i], g1[j], group.mask);
+				} else {
+					group.mask.clear();
+				}
+				const vector<int> &b0 = g0[i].branch;
+				const vector<int> &b1 = g1[j].branch;
+				group.branch.clear();
+				int k = 0, l = 0;
+				while (k < (int)b0.size() or l < (int)b1.size()) {
+					if (k < (int)b0.size() and l < (int)b1.size() and b0[k] == b1[l]) {
+						group.branch.push_back(b0[k]);
 						k++;
-					}
-				} else if (l < (int)g1[j].branch.size()) {
-					if (branch_operation == split_group::UNION) {
-						g0[i].branch.insert(g0[i].branch.begin()+k, g1[j].branch[l]);
+						l++;
+					} else if (k < (int)b0.size() and (l >= (int)b1.size() or b0[k] < b1[l])) {
+						if (branch_operation == split_group::UNION) {
+							group.branch.push_back(b0[k]);
+						}
 						k++;
+					} else {
+						if (branch_operation == split_group::UNION) {
+							group.branch.push_back(b1[l]);
+						}
+						l++;
 					}
-					l++;
 				}
+			} else {
+				std::swap(group.branch, g0[i].branch);
+				std::swap(group.mask, g0[i].mask);
 			}
 			i++;
 			j++;
 		} else if (i < (int)g0.size() and (j >= (int)g1.size() or g0[i].split < g1[j].split)) {
-			if (group_operation == split_group::INTERSECT) {
-				g0.erase(g0.begin()+i);
-			} else {
-				i++;
+			if (group_operation != split_group::INTERSECT) {
+				std::swap(push(), g0[i]);
 			}
+			i++;
 		} else if (j < (int)g1.size()) {
 			if (group_operation == split_group::UNION) {
-				g0.insert(g0.begin()+i, g1[j]);
-				i++;
+				split_group &group = push();
+				group.split = g1[j].split;
+				group.count = g1[j].count;
+				group.branch.assign(g1[j].branch.begin(), g1[j].branch.end());
+				group.mask.assign(g1[j].mask.begin(), g1[j].mask.end());
 			}
 			j++;
 		}
 	}
+
+	scratch.resize(n);
+	std::swap(g0, scratch);
+}
+
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, span<const int> exclude) {
+	static thread_local vector<split_group> scratch;
+	merge_inplace(group_operation, branch_operation, g0, g1, exclude, scratch);
+}
+
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, const set<int> &exclude) {
+	vector<int> sorted(exclude.begin(), exclude.end());
+	merge_inplace(group_operation, branch_operation, g0, g1, sorted);
 }
 
 place::place()
@@ -5,6 +5,9 @@
 #include <common/text.h>
 
 #include <array>
+#include <functional>
+#include <span>
+#include <unordered_map>
 
 namespace petri
 {
@@ -39,6 +42,16 @@ struct split_group
 	std::vector<int> branch; // index of transitions/places coming out of split
 	int count; // total number of branches out of this split
 
+	// The branches as a bitset over the positions of the branch nodes in the
+	// list of successors of the split, or empty if those aren't known. The
+	// graph fills this in for the groups it computes, and compare() and
+	// merge() use it in place of branch when both groups have one. Code that
+	// edits branch must update or clear mask.
+	std::vector<uint64_t> mask;
+
+	bool has_mask() const;
+	void set_mask(int position);
+
 	string to_string() const;
 };
 
@@ -50,9 +63,59 @@ bool operator==(const split_group &g0, int split);
 
 ostream &operator<<(ostream &os, const split_group &g0);
 
-bool compare(int group_operation, int branch_operation, vector<split_group> g0, vector<split_group> g1);
-vector<split_group> merge(int group_operation, int branch_operation, vector<split_group> g0, vector<split_group> g1);
-void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, const vector<split_group> &g1, set<int> exclude=set<int>());
+// An index over the split groups of every node of a graph under one
+// composition. Nodes with identical lists of groups share an entry, and node
+// (type, i) keeps the id of its entry in ids[type][i]. Two nodes have the
+// same groups exactly when they have the same id. The groups themselves stay
+// in the nodes, and owner[k] is a node that holds the groups of entry k.
+//
+// Each entry also has a signature, with one of 64 bits set for each split
+// it has a group for. Two entries with disjoint signatures share no splits.
+struct split_pool
+{
+	split_pool();
+	~split_pool();
+
+	array<vector<int>, 2> ids;
+	vector<pair<int, int> > owner;
+
+	// by entry, the signature and whether some group is missing a branch
+	vector<uint64_t> signature;
+	vector<bool> partial;
+
+	// the entries by a hash of their groups, to find duplicates
+	unordered_multimap<uint64_t, int> index;
+
+	void clear();
+
+	// Add node (type, index) with the given groups, returning the id of its
+	// entry. groups_of(type, index) must return the groups of a node that
+	// was pushed earlier. Nodes may be pushed in any order, and the ones that
+	// are skipped, like erased nodes, have no entry.
+	int push(int type, int index, span<const split_group> groups, function<span<const split_group>(int, int)> groups_of);
+
+	// The id of the entry of node (type, index), or -1 if it was not pushed.
+	int id(int type, int index) const;
+	int entries() const;
+
+	static uint64_t signature_of(int split);
+
+	// The number of bytes held by the pool
+	int64_t memory() const;
+};
+
+// These read the split groups through views so that the groups stored in
+// the nodes can be compared and merged without copying them.
+bool compare(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1);
+// The result of compare() for two lists of groups that share no splits,
+// given whether each has a group that is missing a branch. Returns false
+// and leaves result alone if that is not enough to know.
+bool compare_disjoint(int group_operation, int branch_operation, bool partial0, bool partial1, bool &result);
+vector<split_group> merge(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1);
+void merge(int group_operation, int branch_operation, span<const split_group> g0, span<const split_group> g1, vector<split_group> &result);
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, span<const int> exclude, vector<split_group> &scratch);
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, span<const int> exclude=span<const int>());
+void merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, span<const split_group> g1, const set<int> &exclude);
 
 struct place
 {
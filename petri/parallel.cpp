@@ -0,0 +1,99 @@
+#include "parallel.h"
+
+namespace petri
+{
+
+// Whether the current thread is running a job for some pool.
+static thread_local bool in_job = false;
+
+thread_pool::thread_pool(int threads)
+{
+	if (threads <= 0)
+		threads = max(1, (int)std::thread::hardware_concurrency());
+
+	curr = nullptr;
+	count = 0;
+	round = 0;
+	busy = 0;
+	stop = false;
+	next = 0;
+	for (int i = 1; i < threads; i++)
+		workers.push_back(std::thread(&thread_pool::work, this, i));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto i = workers.begin(); i != workers.end(); i++)
+		i->join();
+}
+
+int thread_pool::size() const
+{
+	return (int)workers.size()+1;
+}
+
+void thread_pool::run(int count, const function<void(int, int)> &job)
+{
+	if (workers.empty() or in_job or count <= 1)
+	{
+		bool nested = in_job;
+		in_job = true;
+		for (int i = 0; i < count; i++)
+			job(0, i);
+		in_job = nested;
+		return;
+	}
+
+	std::lock_guard<std::mutex> serial(running);
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		this->curr = &job;
+		this->count = count;
+		this->next = 0;
+		this->busy = (int)workers.size();
+		this->round++;
+	}
+	wake.notify_all();
+
+	drain(0);
+
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return busy == 0; });
+	this->curr = nullptr;
+}
+
+void thread_pool::work(int thread)
+{
+	int seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this, seen]() { return stop or round != seen; });
+			if (stop)
+				return;
+			seen = round;
+		}
+
+		drain(thread);
+
+		std::unique_lock<std::mutex> guard(lock);
+		if (--busy == 0)
+			idle.notify_all();
+	}
+}
+
+void thread_pool::drain(int thread)
+{
+	in_job = true;
+	for (int i = next++; i < count; i = next++)
+		(*curr)(thread, i);
+	in_job = false;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <common/standard.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace petri
+{
+
+// A fixed set of worker threads used to spread independent per-node passes
+// over the graph, like the all-sources distance computation. The thread that
+// calls run() takes part in the work as thread 0, so a pool of size one
+// runs everything serially on the caller with no extra threads.
+struct thread_pool
+{
+	// threads <= 0 uses one thread per hardware core
+	thread_pool(int threads = 0);
+	~thread_pool();
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	int size() const;
+
+	// Call job(thread, i) once for every i in [0, count) and wait for all of
+	// them to finish. Indices are handed out dynamically, so job must only
+	// write to state owned by i or by thread. Calls from inside a job run
+	// serially on the calling thread.
+	void run(int count, const function<void(int, int)> &job);
+
+private:
+	void work(int thread);
+	void drain(int thread);
+
+	vector<std::thread> workers;
+
+	// serializes calls to run() from different threads
+	std::mutex running;
+	std::mutex lock;
+	std::condition_variable wake, idle;
+	const function<void(int, int)> *curr;
+	int count;
+	int round;
+	int busy;
+	bool stop;
+	std::atomic<int> next;
+};
+
+}
@@ -293,6 +293,7 @@ path_set trace(graph<place, transition, token, state> &g, vector<vector<petri::i
 					groups[k].branch.insert(groups[k].branch.end(), group[j].branch.begin(), group[j].branch.end());
 					sort(groups[k].branch.begin(), groups[k].branch.end());
 					groups[k].branch.erase(unique(groups[k].branch.begin(), groups[k].branch.end()), groups[k].branch.end());
+					groups[k].mask.clear();
 					j--;
 					k--;
 				} else if (group[j].split > groups[k].split) {
@@ -318,7 +319,7 @@ path_set trace(graph<place, transition, token, state> &g, vector<vector<petri::i
 
 		// clean up and fill out the precached "next" lists for the
 		// remaining nodes.
-		for (auto i = g.begin(type); i != g.end(type); i++) {
+		for (auto i = g.begin(type); i != g.end(type); i = g.next_node(i)) {
 			if (n[i.type][i.index].empty()) {
 				n[i.type][i.index] = g.next(i);
 			}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+using namespace petri;
+using namespace std;
+
+using petri_graph = graph<place, transition, token, state<token> >;
+
+// The successors of n found by scanning every arc, which is how the queries
+// behaved before the graph kept adjacency lists.
+vector<petri::iterator> scan_next(const petri_graph &g, petri::iterator n) {
+	vector<petri::iterator> result;
+	for (auto a = g.arcs[n.type].begin(); a != g.arcs[n.type].end(); a++)
+		if (a->from == n)
+			result.push_back(a->to);
+	return result;
+}
+
+vector<petri::iterator> scan_prev(const petri_graph &g, petri::iterator n) {
+	vector<petri::iterator> result;
+	for (auto a = g.arcs[1-n.type].begin(); a != g.arcs[1-n.type].end(); a++)
+		if (a->to == n)
+			result.push_back(a->from);
+	return result;
+}
+
+void check_adjacency(const petri_graph &g) {
+	for (auto n = g.begin(place::type); n != g.end(place::type); n++) {
+		EXPECT_EQ(scan_next(g, n), g.next(n)) << "next " << n.to_string();
+		EXPECT_EQ(scan_prev(g, n), g.prev(n)) << "prev " << n.to_string();
+	}
+	for (auto n = g.begin(transition::type); n != g.end(transition::type); n++) {
+		EXPECT_EQ(scan_next(g, n), g.next(n)) << "next " << n.to_string();
+		EXPECT_EQ(scan_prev(g, n), g.prev(n)) << "prev " << n.to_string();
+	}
+}
+
+TEST(adjacency, edits) {
+	petri_graph g;
+
+	auto p = g.create(place(), 4);
+	auto t = g.create(transition(), 4);
+
+	g.connect({t[0], p[0], t[1], p[1], t[2], p[2], t[0]});
+	g.connect({p[0], t[3], p[3], t[2]});
+	check_adjacency(g);
+
+	g.insert(petri::iterator(transition::type, 0), place());
+	check_adjacency(g);
+
+	g.insert_before(p[1], place());
+	check_adjacency(g);
+
+	g.insert_after(t[3], transition());
+	check_adjacency(g);
+
+	g.insert_alongside(t[1], t[2], place());
+	check_adjacency(g);
+
+	g.duplicate(choice, p[3], true);
+	check_adjacency(g);
+
+	g.duplicate(parallel, t[3], false);
+	check_adjacency(g);
+
+	g.disconnect(petri::iterator(place::type, 1));
+	check_adjacency(g);
+
+	g.erase(p[2]);
+	check_adjacency(g);
+
+	g.erase(t[1]);
+	check_adjacency(g);
+
+	petri_graph h;
+	auto q = h.create(place(), 2);
+	auto u = h.create(transition(), 2);
+	h.connect({u[0], q[0], u[1], q[1], u[0]});
+	g.merge(choice, h);
+	check_adjacency(g);
+}
+
+TEST(adjacency, pinch) {
+	petri_graph g;
+
+	auto p = g.create(place(), 3);
+	auto t = g.create(transition(), 3);
+
+	g.connect({t[0], p[0], t[1], p[1], t[2], p[2], t[0]});
+	g.pinch(p[1]);
+	check_adjacency(g);
+}
+
+TEST(adjacency, disconnect) {
+	petri_graph g;
+
+	auto p = g.create(place(), 3);
+	auto t = g.create(transition(), 3);
+
+	g.connect({t[0], p[0], t[1], p[1], t[2], p[2], t[0]});
+	g.connect({t[0], p[1], t[2], p[0]});
+	check_adjacency(g);
+
+	// arcs of both types, out of order
+	g.disconnect({petri::iterator(transition::type, 4), petri::iterator(place::type, 0), petri::iterator(transition::type, 1)});
+	check_adjacency(g);
+	EXPECT_EQ(3, (int)g.arcs[place::type].size());
+	EXPECT_EQ(3, (int)g.arcs[transition::type].size());
+}
+
+TEST(adjacency, direct_edits) {
+	petri_graph g;
+
+	auto p = g.create(place(), 3);
+	auto t = g.create(transition(), 3);
+
+	g.connect({t[0], p[0], t[1], p[1], t[2], p[2], t[0]});
+	check_adjacency(g);
+
+	// rewire an arc without changing the number of arcs
+	g.arcs[place::type][0].to = t[2];
+	g.mark_modified();
+	check_adjacency(g);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <random>
 #include <vector>
 
 #include <petri/graph.h>
@@ -742,6 +743,42 @@ TEST(composition, regular_choice_parallel) {
 	test_always(g, implies, {p[2], p[5]}, {t[6]}, true);
 }
 
+TEST(composition, threads) {
+	// The same net as sequence_choice_parallel, with the splits computed
+	// serially and on a thread pool.
+
+	graph<place, transition, token, state<token> > g0;
+
+	auto p = g0.create(place(), 13);
+	auto t = g0.create(transition(), 13);
+
+	g0.connect({p[0], t[0], p[1], t[1], p[2], t[3]});
+	g0.connect({t[0], p[3], t[2], p[4], t[3], p[6]});
+	g0.connect({p[0], t[4], p[5], t[5], p[6]});
+	g0.connect(p[6], t[6]);
+	g0.connect({t[6], p[7], t[7], p[8], t[8], p[10]});
+	g0.connect({p[7], t[9], p[9], t[10], p[10], t[12]});
+	g0.connect({t[6], p[11], t[11], p[12], t[12]});
+	g0.connect(t[12], p[0]);
+
+	g0.reset.push_back(state<token>({token(p[0].index)}));
+
+	graph<place, transition, token, state<token> > g1 = g0;
+	g1.set_threads(4);
+
+	g0.compute_split_groups();
+	g1.compute_split_groups();
+
+	for (int composition = 0; composition < 2; composition++) {
+		for (int i = 0; i < (int)p.size(); i++) {
+			EXPECT_EQ(g0.split_groups_of(composition, p[i]), g1.split_groups_of(composition, p[i])) << p[i];
+		}
+		for (int i = 0; i < (int)t.size(); i++) {
+			EXPECT_EQ(g0.split_groups_of(composition, t[i]), g1.split_groups_of(composition, t[i])) << t[i];
+		}
+	}
+}
+
 /* This structure violates liveness
 
 TEST(composition, regular_parallel_choice) {
@@ -794,3 +831,230 @@ TEST(composition, regular_parallel_choice) {
 }*/
 
 
+
+TEST(composition, local_edits) {
+	// A ring of parallel and conditional stages that is edited locally,
+	// checking the patched split groups against a full recompute after each
+	// edit.
+
+	graph<place, transition, token, state<token> > g;
+
+	const int stages = 8;
+	vector<petri::iterator> links = g.create(place(), stages);
+	vector<vector<petri::iterator> > branches;
+	for (int i = 0; i < stages; i++) {
+		petri::iterator from = links[i], to = links[(i+1)%stages];
+		if (i%2 == 0) {
+			auto t = g.create(transition(), 4);
+			auto p = g.create(place(), 4);
+			g.connect({from, t[0], p[0], t[1], p[1], t[3], to});
+			g.connect({t[0], p[2], t[2], p[3], t[3]});
+			branches.push_back({p[0], t[1], p[1], p[2], t[2], p[3]});
+		} else {
+			auto t = g.create(transition(), 4);
+			auto p = g.create(place(), 2);
+			g.connect({from, t[0], p[0], t[1], to});
+			g.connect({from, t[2], p[1], t[3], to});
+			branches.push_back({t[0], p[0], t[1], t[2], p[1], t[3]});
+		}
+	}
+	g.reset.push_back(state<token>({token(links[0].index)}));
+	g.compute_split_groups();
+
+	auto check = [&g](bool local) {
+		EXPECT_TRUE(g.split_groups_stale);
+		EXPECT_EQ(local, g.update_split_groups());
+		if (not local) {
+			g.compute_split_groups();
+		}
+
+		graph<place, transition, token, state<token> > expect = g;
+		expect.mark_modified();
+		expect.compute_split_groups();
+		for (int composition = 0; composition < 2; composition++) {
+			for (int type = 0; type < 2; type++) {
+				for (petri::iterator i = g.begin(type); i != g.end(type); i++) {
+					EXPECT_EQ(expect.split_groups_of(composition, i), g.split_groups_of(composition, i)) << composition << " " << i;
+				}
+			}
+		}
+	};
+
+	g.insert_after(branches[0][0], transition());
+	check(true);
+
+	g.insert_before(branches[1][1], place());
+	check(true);
+
+	g.insert_after(links[2], place());
+	check(true);
+
+	// These move or add branches of existing nodes, so they recompute
+	// everything
+	g.insert_after(links[3], place());
+	check(false);
+
+	g.insert_alongside(branches[2][1], branches[2][2], place());
+	check(false);
+
+	g.connect(branches[4][4], g.create(transition()));
+	check(false);
+}
+
+TEST(composition, local_edits_random) {
+	// Random edits to random nets, checking the patched split groups against
+	// a full recompute after each edit.
+	mt19937 rng(7);
+	auto pick = [&rng](int n) {
+		return (int)(rng()%n);
+	};
+
+	int patched = 0;
+	for (int net = 0; net < 200; net++) {
+		graph<place, transition, token, state<token> > g;
+		int np = 4 + pick(12), nt = 4 + pick(12);
+		auto p = g.create(place(), np);
+		auto t = g.create(transition(), nt);
+		for (int i = 0; i < np; i++) {
+			g.connect(p[i], t[pick(nt)]);
+		}
+		for (int i = 0; i < nt; i++) {
+			g.connect(t[i], p[pick(np)]);
+		}
+		for (int extra = pick(np+nt); extra > 0; extra--) {
+			if (pick(2)) {
+				g.connect(p[pick(np)], t[pick(nt)]);
+			} else {
+				g.connect(t[pick(nt)], p[pick(np)]);
+			}
+		}
+		g.reset.push_back(state<token>({token(pick(np))}));
+		g.compute_split_groups();
+
+		for (int edit = 0; edit < 4; edit++) {
+			petri::iterator n = pick(2) ? p[pick(np)] : t[pick(nt)];
+			switch (pick(5)) {
+			case 0: g.insert_after(n, place()); break;
+			case 1: g.insert_after(n, transition()); break;
+			case 2: g.insert_before(n, transition()); break;
+			case 3: g.insert_alongside(p[pick(np)], t[pick(nt)], place()); break;
+			default: g.connect(p[pick(np)], g.create(transition())); break;
+			}
+
+			if (g.update_split_groups()) {
+				patched++;
+			} else {
+				g.compute_split_groups();
+			}
+
+			graph<place, transition, token, state<token> > expect = g;
+			expect.mark_modified();
+			expect.compute_split_groups();
+			for (int composition = 0; composition < 2; composition++) {
+				for (int type = 0; type < 2; type++) {
+					for (petri::iterator i = g.begin(type); i != g.end(type); i++) {
+						EXPECT_EQ(expect.split_groups_of(composition, i), g.split_groups_of(composition, i)) << net << " " << edit << " " << composition << " " << i;
+					}
+				}
+			}
+		}
+	}
+	EXPECT_GT(patched, 0);
+}
+
+TEST(composition, relation_cache) {
+	// The same net as sequence_choice_parallel, queried with and without the
+	// relation cache, and with a cache that is too small to be used.
+
+	graph<place, transition, token, state<token> > g0;
+
+	auto p = g0.create(place(), 13);
+	auto t = g0.create(transition(), 13);
+
+	g0.connect({p[0], t[0], p[1], t[1], p[2], t[3]});
+	g0.connect({t[0], p[3], t[2], p[4], t[3], p[6]});
+	g0.connect({p[0], t[4], p[5], t[5], p[6]});
+	g0.connect(p[6], t[6]);
+	g0.connect({t[6], p[7], t[7], p[8], t[8], p[10]});
+	g0.connect({p[7], t[9], p[9], t[10], p[10], t[12]});
+	g0.connect({t[6], p[11], t[11], p[12], t[12]});
+	g0.connect(t[12], p[0]);
+
+	g0.reset.push_back(state<token>({token(p[0].index)}));
+
+	graph<place, transition, token, state<token> > g1 = g0, g2 = g0;
+	g1.set_relation_cache(true);
+	g2.set_relation_cache(true, 1);
+
+	vector<petri::iterator> nodes = p;
+	nodes.insert(nodes.end(), t.begin(), t.end());
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			for (int composition = 0; composition < 5; composition++) {
+				for (int flags = 0; flags < 4; flags++) {
+					bool expect = g0.is(composition, *a, *b, flags&1, flags&2);
+					EXPECT_EQ(expect, g1.is(composition, *a, *b, flags&1, flags&2)) << composition << " " << flags << " " << *a << " " << *b;
+					EXPECT_EQ(expect, g2.is(composition, *a, *b, flags&1, flags&2)) << composition << " " << flags << " " << *a << " " << *b;
+				}
+			}
+		}
+	}
+	EXPECT_TRUE(g1.relations_ready);
+	EXPECT_FALSE(g2.relations_ready);
+
+	// edits invalidate the cache
+	g1.insert_after(t[2], place());
+	g0.insert_after(t[2], place());
+	EXPECT_FALSE(g1.relations_ready);
+	EXPECT_EQ(g0.is(parallel, p[4], t[10]), g1.is(parallel, p[4], t[10]));
+	EXPECT_EQ(g0.is(choice, p[4], p[5], true), g1.is(choice, p[4], p[5], true));
+}
+
+TEST(composition, parallel_neighbors) {
+	// The same net as sequence_choice_parallel, deinterfered with and
+	// without the parallel neighborhoods, and with neighborhoods that are too
+	// large to be used.
+
+	graph<place, transition, token, state<token> > g0;
+
+	auto p = g0.create(place(), 13);
+	auto t = g0.create(transition(), 13);
+
+	g0.connect({p[0], t[0], p[1], t[1], p[2], t[3]});
+	g0.connect({t[0], p[3], t[2], p[4], t[3], p[6]});
+	g0.connect({p[0], t[4], p[5], t[5], p[6]});
+	g0.connect(p[6], t[6]);
+	g0.connect({t[6], p[7], t[7], p[8], t[8], p[10]});
+	g0.connect({p[7], t[9], p[9], t[10], p[10], t[12]});
+	g0.connect({t[6], p[11], t[11], p[12], t[12]});
+	g0.connect(t[12], p[0]);
+
+	g0.reset.push_back(state<token>({token(p[0].index)}));
+
+	graph<place, transition, token, state<token> > g1 = g0, g2 = g0;
+	g1.set_parallel_neighbors(true);
+	g2.set_parallel_neighbors(true, 1);
+
+	vector<petri::iterator> nodes = p;
+	nodes.insert(nodes.end(), t.begin(), t.end());
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			auto expect = g0.deinterfere({*a}, {*b});
+			EXPECT_EQ(expect, g1.deinterfere({*a}, {*b})) << *a << " " << *b;
+			EXPECT_EQ(expect, g2.deinterfere({*a}, {*b})) << *a << " " << *b;
+
+			expect = g0.deinterfere({*a, p[8]}, {*b, t[11]});
+			EXPECT_EQ(expect, g1.deinterfere({*a, p[8]}, {*b, t[11]})) << *a << " " << *b;
+		}
+	}
+	EXPECT_TRUE(g1.neighbors_ready);
+	EXPECT_FALSE(g2.neighbors_ready);
+
+	EXPECT_EQ(g0.deinterfere_choice({p[1], p[8]}, {p[4], p[12]}), g1.deinterfere_choice({p[1], p[8]}, {p[4], p[12]}));
+
+	// edits invalidate the neighborhoods
+	auto q0 = g0.insert_after(t[2], place());
+	auto q1 = g1.insert_after(t[2], place());
+	EXPECT_EQ(g0.deinterfere({q0}, {p[9]}), g1.deinterfere({q1}, {p[9]}));
+	EXPECT_EQ(g0.deinterfere({p[1]}, {t[10]}), g1.deinterfere({p[1]}, {t[10]}));
+}
@@ -9,6 +9,8 @@
 using namespace petri;
 using namespace std;
 
+using petri_graph = graph<place, transition, token, state<token> >;
+
 void check_distance(const graph<place, transition, token, state<token> > &g, int distance, petri::iterator from, petri::iterator to) {
 	EXPECT_EQ(distance, g.distance(from, to)) << "expected " << from.to_string() << "->" << distance << "->" << to.to_string();
 }
@@ -89,3 +91,209 @@ TEST(distance, choice) {
 	check_distance(g, 6, t[2], t[1]);
 }
 
+
+TEST(distance, reachability) {
+	//  =->t0-->p0-->t1-->p1-->t2-=    p3-->t4-->p4
+	//      ^                  |
+	//      |                  v
+	//      +-----p2<-----t3<--+
+
+	graph<place, transition, token, state<token> > g;
+
+	auto p = g.create(place(), 5);
+	auto t = g.create(transition(), 5);
+
+	g.connect({t[0], p[0], t[1], p[1], t[2]});
+	g.connect({p[1], t[3], p[2], t[0]});
+	g.connect({p[3], t[4], p[4]});
+
+	g.update_node_distances();
+
+	vector<petri::iterator> n;
+	n.insert(n.end(), p.begin(), p.end());
+	n.insert(n.end(), t.begin(), t.end());
+	for (auto i = n.begin(); i != n.end(); i++) {
+		for (auto j = n.begin(); j != n.end(); j++) {
+			EXPECT_EQ(g.distance(*i, *j) >= 0, g.is_reachable(*i, *j)) << i->to_string() << "->" << j->to_string();
+		}
+	}
+
+	EXPECT_TRUE(g.is_reachable(p[1], p[0]));
+	EXPECT_FALSE(g.is_reachable(t[2], p[0]));
+	EXPECT_FALSE(g.is_reachable(p[4], p[3]));
+	EXPECT_FALSE(g.is_reachable({p[4], p[3]}, {t[2]}));
+	EXPECT_TRUE(g.is_reachable({p[4], p[0]}, {t[2]}));
+}
+
+TEST(distance, threads) {
+	// A ring of fork-join stages, computed serially and over a thread pool
+
+	graph<place, transition, token, state<token> > g0;
+
+	const int stages = 50;
+	petri::iterator first = g0.create(transition());
+	petri::iterator prev = first;
+	for (int i = 0; i < stages; i++) {
+		auto p = g0.create(place(), 4);
+		auto t = g0.create(transition(), 3);
+		g0.connect({prev, p[0], t[0], p[1], t[2]});
+		g0.connect({prev, p[2], t[1], p[3], t[2]});
+		prev = t[2];
+	}
+	auto p = g0.create(place());
+	g0.connect({prev, p, first});
+
+	graph<place, transition, token, state<token> > g1 = g0;
+	g1.set_threads(4);
+	EXPECT_EQ(4, g1.threads());
+
+	g0.update_node_distances();
+	g1.update_node_distances();
+	EXPECT_EQ(g0.node_distances, g1.node_distances);
+}
+
+TEST(distance, local_edits) {
+	// A chain of fork-join stages that is edited near its end, checking the
+	// patched matrix against a full recompute after each edit.
+
+	petri_graph g;
+
+	const int stages = 20;
+	vector<petri::iterator> joins;
+	petri::iterator prev = g.create(transition());
+	for (int i = 0; i < stages; i++) {
+		auto p = g.create(place(), 4);
+		auto t = g.create(transition(), 3);
+		g.connect({prev, p[0], t[0], p[1], t[2]});
+		g.connect({prev, p[2], t[1], p[3], t[2]});
+		prev = t[2];
+		joins.push_back(t[2]);
+	}
+
+	g.update_node_distances();
+
+	auto check = [&g](bool local) {
+		EXPECT_TRUE(g.node_distances_stale);
+		EXPECT_EQ(local, g.update_touched_distances());
+		g.update_node_distances();
+
+		petri_graph expect = g;
+		expect.mark_modified();
+		expect.update_node_distances();
+		EXPECT_EQ(expect.node_distances, g.node_distances);
+	};
+
+	g.insert_after(joins[stages-2], place());
+	check(true);
+
+	g.insert_before(joins[stages-1], transition());
+	check(true);
+
+	g.insert_alongside(joins[stages-3], joins[stages-2], place());
+	check(true);
+
+	g.connect(joins[stages-2], g.create(place()));
+	check(true);
+
+	// too disruptive, falls back to a full recompute
+	g.insert_after(joins[0], place());
+	check(false);
+}
+
+TEST(distance, storage) {
+	// The same net with a full 32 bit matrix and with lazy 16 bit rows
+
+	petri_graph g0;
+	petri::iterator first = g0.create(transition());
+	petri::iterator prev = first;
+	for (int i = 0; i < 10; i++) {
+		auto p = g0.create(place(), 4);
+		auto t = g0.create(transition(), 3);
+		g0.connect({prev, p[0], t[0], p[1], t[2]});
+		g0.connect({prev, p[2], t[1], p[3], t[2]});
+		prev = t[2];
+	}
+
+	petri_graph g1 = g0;
+	g0.set_distance_storage(false, 4);
+	g1.set_distance_storage(true);
+
+	petri::iterator from(place::type, 3), to(transition::type, 20);
+	EXPECT_EQ(g0.distance(from, to), g1.distance(from, to));
+	EXPECT_EQ(4, g0.node_distances.width);
+	EXPECT_EQ(2, g1.node_distances.width);
+
+	// only the row of the target was computed
+	int offset = (int)g1.places.size();
+	for (int i = 0; i < g1.size(); i++) {
+		EXPECT_EQ(i == offset + to.index, g1.node_distances.has_row(i));
+	}
+
+	g0.insert_after(petri::iterator(transition::type, 25), place());
+	g1.insert_after(petri::iterator(transition::type, 25), place());
+	for (int i = 0; i < g0.size(); i++) {
+		for (int j = 0; j < g0.size(); j++) {
+			petri::iterator a = i < (int)g0.places.size() ? petri::iterator(place::type, i) : petri::iterator(transition::type, i - (int)g0.places.size());
+			petri::iterator b = j < (int)g0.places.size() ? petri::iterator(place::type, j) : petri::iterator(transition::type, j - (int)g0.places.size());
+			EXPECT_EQ(g0.distance(a, b), g1.distance(a, b)) << a.to_string() << "->" << b.to_string();
+		}
+	}
+
+	// distances may be overwritten until the next edit, widening the 16 bit
+	// rows if needed
+	g0.set_distance(from, to, 7);
+	g1.set_distance(from, to, 100000);
+	EXPECT_EQ(7, g0.distance(from, to));
+	EXPECT_EQ(100000, g1.distance(from, to));
+	EXPECT_EQ(4, g1.node_distances.width);
+	EXPECT_EQ(g0.distance(to, from), g1.distance(to, from));
+}
+
+TEST(distance, lazy_rows) {
+	petri_graph g0;
+	auto p = g0.create(place(), 6);
+	auto t = g0.create(transition(), 6);
+	for (int i = 0; i < 6; i++) {
+		g0.connect(t[i], p[i]);
+		g0.connect(p[i], t[(i+1)%6]);
+	}
+
+	petri_graph g1 = g0;
+	g1.set_distance_storage(true, 0, 3);
+
+	EXPECT_EQ(g0.distance(p[0], t[3]), g1.distance(p[0], t[3]));
+	EXPECT_EQ(g0.distance(p[1], t[4]), g1.distance(p[1], t[4]));
+	EXPECT_EQ(g0.distance(p[2], t[5]), g1.distance(p[2], t[5]));
+	EXPECT_EQ(3, g1.node_distances.resident());
+
+	// t[3] is used again, so t[4] is the one dropped for t[0]
+	EXPECT_EQ(g0.distance(p[4], t[3]), g1.distance(p[4], t[3]));
+	EXPECT_EQ(g0.distance(p[5], t[0]), g1.distance(p[5], t[0]));
+	EXPECT_EQ(3, g1.node_distances.resident());
+
+	int offset = (int)g1.places.size();
+	EXPECT_TRUE(g1.node_distances.has_row(offset + t[3].index));
+	EXPECT_FALSE(g1.node_distances.has_row(offset + t[4].index));
+	EXPECT_TRUE(g1.node_distances.has_row(offset + t[5].index));
+	EXPECT_TRUE(g1.node_distances.has_row(offset + t[0].index));
+
+	EXPECT_EQ(g0.distance(p[1], t[4]), g1.distance(p[1], t[4]));
+
+	// the rows that survive a local edit keep their order of use, and every
+	// row in that order is stored
+	g0.insert_after(t[1], place());
+	g1.insert_after(t[1], place());
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j < 6; j++) {
+			EXPECT_EQ(g0.distance(p[i], t[j]), g1.distance(p[i], t[j]));
+			EXPECT_EQ(g0.distance(t[i], p[j]), g1.distance(t[i], p[j]));
+		}
+	}
+	EXPECT_EQ(3, g1.node_distances.resident());
+	int64_t listed = 0;
+	for (int64_t r = g1.node_distances.least_recently_used(); r >= 0; r = g1.node_distances.rows[r].newer) {
+		EXPECT_TRUE(g1.node_distances.has_row(r));
+		listed++;
+	}
+	EXPECT_EQ(3, listed);
+}
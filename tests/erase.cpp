@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+using namespace petri;
+using namespace std;
+
+using petri_graph = graph<place, transition, token, state<token> >;
+
+petri_graph make_net(vector<petri::iterator> &p, vector<petri::iterator> &t) {
+	//        ->p1-->t1-->p2-         .
+	//       /               \        .
+	// =->t0                  >t3-=   .
+	//       \               /        .
+	//        ->p3-->t2-->p4-         .
+	//
+	//  p0 sits between t3 and t0
+
+	petri_graph g;
+	p = g.create(place(), 5);
+	t = g.create(transition(), 4);
+
+	g.connect({t[3], p[0], t[0], p[1], t[1], p[2], t[3]});
+	g.connect({t[0], p[3], t[2], p[4], t[3]});
+	g.reset.push_back(state<token>({token(p[1].index), token(p[3].index)}));
+	g.source.push_back(state<token>({token(p[0].index)}));
+	return g;
+}
+
+TEST(erase, batch) {
+	vector<petri::iterator> p, t;
+	petri_graph g0 = make_net(p, t);
+	petri_graph g1 = make_net(p, t);
+
+	vector<petri::iterator> doomed = {p[1], t[2], p[4]};
+	g0.erase(p[4]);
+	g0.erase(t[2]);
+	g0.erase(p[1]);
+	remapping r = g1.erase_batch(doomed);
+
+	ASSERT_EQ(g0.places.size(), g1.places.size());
+	ASSERT_EQ(g0.transitions.size(), g1.transitions.size());
+	EXPECT_EQ(g0.arcs[place::type], g1.arcs[place::type]);
+	EXPECT_EQ(g0.arcs[transition::type], g1.arcs[transition::type]);
+	ASSERT_EQ(g0.reset.size(), g1.reset.size());
+	EXPECT_EQ(g0.reset[0].tokens.size(), g1.reset[0].tokens.size());
+	EXPECT_EQ(g0.reset[0].tokens[0].index, g1.reset[0].tokens[0].index);
+	EXPECT_EQ(g0.source[0].tokens[0].index, g1.source[0].tokens[0].index);
+
+	for (auto n = g1.begin(place::type); n != g1.end(place::type); n++) {
+		EXPECT_EQ(g0.next(n), g1.next(n));
+		EXPECT_EQ(g0.prev(n), g1.prev(n));
+	}
+	for (auto n = g1.begin(transition::type); n != g1.end(transition::type); n++) {
+		EXPECT_EQ(g0.next(n), g1.next(n));
+		EXPECT_EQ(g0.prev(n), g1.prev(n));
+	}
+
+	vector<petri::iterator> iter_list0 = {p[0], p[1], p[2], p[3], p[4], t[0], t[1], t[2], t[3]};
+	vector<petri::iterator> iter_list1 = iter_list0;
+	petri_graph::erase(doomed, iter_list0);
+	r.apply(iter_list1);
+	EXPECT_EQ(iter_list0, iter_list1);
+
+	EXPECT_TRUE(r.erased(p[1]));
+	EXPECT_FALSE(r.erased(p[2]));
+	EXPECT_EQ(petri::iterator(place::type, 1), r.map(p[2]));
+	EXPECT_EQ(petri::iterator(transition::type, 2), r.map(t[3]));
+}
+
+TEST(erase, stable_handles) {
+	vector<petri::iterator> p, t;
+	petri_graph g0 = make_net(p, t);
+	petri_graph g1 = make_net(p, t);
+
+	g1.set_stable_handles(true);
+	int gen = g1.generation(p[2]);
+
+	vector<petri::iterator> doomed = {p[1], t[2], p[4]};
+	g0.erase(doomed);
+	g1.erase(p[1]);
+	g1.erase(vector<petri::iterator>({t[2], p[4]}));
+
+	// nothing was renumbered
+	EXPECT_EQ(5u, g1.places.size());
+	EXPECT_EQ(4u, g1.transitions.size());
+	EXPECT_TRUE(g1.is_tombstone(p[1]));
+	EXPECT_TRUE(g1.is_tombstone(t[2]));
+	EXPECT_FALSE(g1.is_tombstone(p[2]));
+	EXPECT_TRUE(g1.is_valid(p[2], gen));
+	EXPECT_FALSE(g1.is_valid(p[1], g1.generation(p[1])));
+	EXPECT_TRUE(g1.next(p[1]).empty());
+	EXPECT_EQ(vector<petri::iterator>({t[1]}), g1.prev(p[2]));
+	EXPECT_EQ(vector<petri::iterator>({p[2]}), g1.prev(t[3]));
+
+	vector<petri::iterator> live;
+	for (auto n = g1.begin(place::type); n != g1.end(place::type); n = g1.next_node(n))
+		live.push_back(n);
+	EXPECT_EQ(vector<petri::iterator>({p[0], p[2], p[3]}), live);
+	EXPECT_EQ(p[3], g1.rbegin(place::type));
+
+	vector<petri::iterator> iter_list0 = {p[0], p[1], p[2], p[3], p[4], t[0], t[1], t[2], t[3]};
+	vector<petri::iterator> iter_list1 = iter_list0;
+	petri_graph::erase(doomed, iter_list0);
+	g1.set_stable_handles(false).apply(iter_list1);
+	EXPECT_EQ(iter_list0, iter_list1);
+
+	// leaving stable handle mode compacts the graph
+	EXPECT_FALSE(g1.is_valid(petri::iterator(place::type, 1), gen));
+	ASSERT_EQ(g0.places.size(), g1.places.size());
+	ASSERT_EQ(g0.transitions.size(), g1.transitions.size());
+	EXPECT_EQ(g0.arcs[place::type], g1.arcs[place::type]);
+	EXPECT_EQ(g0.arcs[transition::type], g1.arcs[transition::type]);
+	EXPECT_EQ(g0.reset[0].tokens.size(), g1.reset[0].tokens.size());
+	EXPECT_EQ(g0.source[0].tokens[0].index, g1.source[0].tokens[0].index);
+}
+
+TEST(erase, stable_relations) {
+	// Relations between the remaining nodes don't depend on whether the
+	// erased nodes were left behind as tombstones, including the first one.
+	vector<petri::iterator> p, t;
+	petri_graph g0 = make_net(p, t);
+	petri_graph g1 = make_net(p, t);
+	petri_graph g2 = make_net(p, t);
+	g1.set_stable_handles(true);
+	g2.set_stable_handles(true);
+	g2.set_relation_cache(true);
+
+	remapping r = g0.erase_batch({p[0]});
+	g1.erase(p[0]);
+	g2.erase(p[0]);
+
+	vector<petri::iterator> nodes = {p[1], p[2], p[3], p[4], t[0], t[1], t[2], t[3]};
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			for (int composition = 0; composition < 5; composition++) {
+				bool expect = g0.is(composition, r.map(*a), r.map(*b));
+				EXPECT_EQ(expect, g1.is(composition, *a, *b)) << composition << " " << *a << " " << *b;
+				EXPECT_EQ(expect, g2.is(composition, *a, *b)) << composition << " " << *a << " " << *b;
+			}
+		}
+	}
+	EXPECT_TRUE(g1.is(parallel, p[1], p[3]));
+	EXPECT_FALSE(g1.is(parallel, p[1], p[2]));
+}
+
+TEST(erase, stable_iteration) {
+	// The net of make_net() with a dead end hanging off t1 and a choice off
+	// p3 that are erased in stable handle mode. The first place and the first
+	// transition are both erased, along with one of each in the middle.
+	petri_graph g0, g1;
+	vector<petri::iterator> p, t;
+	for (petri_graph *g : {&g0, &g1}) {
+		p = g->create(place(), 7);
+		t = g->create(transition(), 6);
+		g->connect({t[5], p[1], t[1], p[2], t[2], p[3], t[5]});
+		g->connect({t[1], p[5], t[4], p[6], t[5]});
+		g->connect({t[2], p[0], t[0]});
+		g->connect({p[5], t[3], p[4]});
+		g->reset.push_back(state<token>({token(p[2].index), token(p[5].index)}));
+	}
+	vector<petri::iterator> doomed = {p[0], p[4], t[0], t[3]};
+	remapping r = g0.erase_batch(doomed);
+	g1.set_stable_handles(true);
+	g1.erase(doomed);
+	g1.set_parallel_neighbors(true);
+
+	array<vector<petri::iterator>, 2> live;
+	live[place::type] = {p[1], p[2], p[3], p[5], p[6]};
+	live[transition::type] = {t[1], t[2], t[4], t[5]};
+	vector<petri::iterator> nodes;
+	for (int type = 0; type < 2; type++) {
+		vector<petri::iterator> forward, backward;
+		for (auto i = g1.begin(type); i != g1.end(type); i = g1.next_node(i)) {
+			forward.push_back(i);
+		}
+		for (auto i = g1.rbegin(type); i != g1.rend(type); i = g1.prev_node(i)) {
+			backward.insert(backward.begin(), i);
+		}
+		EXPECT_EQ(live[type], forward);
+		EXPECT_EQ(live[type], backward);
+		nodes.insert(nodes.end(), live[type].begin(), live[type].end());
+	}
+
+	auto map_all = [&r](vector<vector<petri::iterator> > v) {
+		for (auto i = v.begin(); i != v.end(); i++) {
+			r.apply(*i);
+		}
+		return v;
+	};
+
+	// The analyses give the same answers as on the compacted graph
+	for (int composition : {parallel, choice, sequence, implies, excludes}) {
+		vector<petri::iterator> mapped = nodes;
+		r.apply(mapped);
+		EXPECT_EQ(g0.select(composition, mapped), map_all(g1.select(composition, nodes)));
+		for (auto a = nodes.begin(); a != nodes.end(); a++) {
+			EXPECT_EQ(g0.partials(composition, {r.map(*a)}), map_all(g1.partials(composition, {*a}))) << *a;
+		}
+	}
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			auto expect = g0.deinterfere({r.map(*a)}, {r.map(*b)});
+			auto found = g1.deinterfere({*a}, {*b});
+			ASSERT_EQ(expect.size(), found.size()) << *a << " " << *b;
+			for (int k = 0; k < (int)found.size(); k++) {
+				r.apply(found[k][0]);
+				r.apply(found[k][1]);
+			}
+			EXPECT_EQ(expect, found) << *a << " " << *b;
+		}
+	}
+	EXPECT_FALSE(g1.split_groups_of(parallel, p[6]).empty());
+	EXPECT_TRUE(g1.split_groups_of(parallel, p[0]).empty());
+}
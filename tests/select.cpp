@@ -636,6 +636,200 @@ TEST(select, regular_choice_parallel) {
 	EXPECT_EQ(mark({{t[1],t[3]},{t[2],t[3]},{t[1],t[5]},{t[2],t[5]}}), g.select(excludes, {t[1], t[2], t[3], t[5]}, true, true));
 }
 
+// A ring through a fork into the given number of parallel branches, each a
+// chain of the given number of places, and a join.
+graph<place, transition, token, state<token> > make_branches(int branches, int length, vector<petri::iterator> &places) {
+	graph<place, transition, token, state<token> > g;
+	petri::iterator fork = g.create(transition());
+	petri::iterator join = g.create(transition());
+	for (int i = 0; i < branches; i++) {
+		petri::iterator prev = fork;
+		for (int j = 0; j < length; j++) {
+			petri::iterator p = g.create(place());
+			places.push_back(p);
+			g.connect(prev, p);
+			prev = g.create(transition());
+			g.connect(p, prev);
+		}
+		g.connect(prev, g.create(place()));
+		g.connect(petri::iterator(place::type, g.size(place::type)-1), join);
+	}
+	petri::iterator link = g.create(place());
+	g.connect({join, link, fork});
+	g.reset.push_back(state<token>({token(link.index)}));
+	g.compute_split_groups();
+	return g;
+}
+
+TEST(select, wide_parallel) {
+	// Every way to pick one place from each branch is a maximal clique
+	vector<petri::iterator> places;
+	auto g = make_branches(4, 3, places);
+
+	vector<vector<petri::iterator> > result = g.select(parallel, places);
+	EXPECT_EQ(81, (int)result.size());
+	for (auto clique = result.begin(); clique != result.end(); clique++) {
+		EXPECT_EQ(4, (int)clique->size());
+	}
+	sort(result.begin(), result.end());
+	EXPECT_TRUE(unique(result.begin(), result.end()) == result.end());
+
+	// Without parallelism, every place is alone
+	EXPECT_EQ(12, (int)g.select(choice, places).size());
+}
+
+TEST(select, threads) {
+	// The thread pool gives the same cliques in the same order
+	vector<petri::iterator> places;
+	auto g = make_branches(4, 3, places);
+	auto h = g;
+	h.set_threads(4);
+	for (int composition : {parallel, choice, sequence, implies, excludes}) {
+		for (int always = 0; always < 2; always++) {
+			for (int invert = 0; invert < 2; invert++) {
+				EXPECT_EQ(g.select(composition, places, always, invert), h.select(composition, places, always, invert));
+			}
+		}
+	}
+
+	vector<vector<petri::iterator> > parts;
+	for (int i = 0; i+1 < (int)places.size(); i += 2) {
+		parts.push_back({places[i], places[i+1]});
+	}
+	for (int composition : {parallel, choice, implies, excludes}) {
+		EXPECT_EQ(g.group(composition, parts), h.group(composition, parts));
+	}
+}
+
+TEST(select, each) {
+	vector<petri::iterator> places;
+	auto g = make_branches(4, 3, places);
+
+	// Every clique is visited once
+	vector<vector<petri::iterator> > expect = g.select(parallel, places);
+	vector<vector<petri::iterator> > found;
+	EXPECT_TRUE(g.select_each(parallel, places, [&found](const vector<petri::iterator> &clique) {
+		found.push_back(clique);
+		return true;
+	}));
+	sort(expect.begin(), expect.end());
+	sort(found.begin(), found.end());
+	EXPECT_EQ(expect, found);
+
+	// Stop after a few cliques, or when asked to
+	clique_limits limits;
+	limits.count = 5;
+	found.clear();
+	EXPECT_FALSE(g.select_each(parallel, places, [&found](const vector<petri::iterator> &clique) {
+		found.push_back(clique);
+		return true;
+	}, false, false, limits));
+	EXPECT_EQ(5, (int)found.size());
+
+	int visited = 0;
+	EXPECT_FALSE(g.select_each(parallel, places, [&visited](const vector<petri::iterator> &clique) {
+		return ++visited < 3;
+	}));
+	EXPECT_EQ(3, visited);
+
+	// Only the cliques within the size limits
+	for (int size = 1; size <= 5; size++) {
+		limits = clique_limits();
+		limits.min_size = size;
+		limits.max_size = size;
+		int count = 0;
+		EXPECT_TRUE(g.select_each(parallel, places, [&count, size](const vector<petri::iterator> &clique) {
+			EXPECT_EQ(size, (int)clique.size());
+			count++;
+			return true;
+		}, false, false, limits));
+		int expect_count = 0;
+		for (auto clique = expect.begin(); clique != expect.end(); clique++) {
+			expect_count += (int)clique->size() == size;
+		}
+		EXPECT_EQ(expect_count, count);
+	}
+
+	// Groups
+	vector<vector<petri::iterator> > parts;
+	for (int i = 0; i+1 < (int)places.size(); i += 2) {
+		parts.push_back({places[i], places[i+1]});
+	}
+	vector<vector<petri::iterator> > grouped = g.group(choice, parts);
+	vector<vector<petri::iterator> > merged(grouped.begin() + parts.size(), grouped.end());
+	found.clear();
+	EXPECT_TRUE(g.group_each(choice, parts, [&found](const vector<petri::iterator> &group) {
+		found.push_back(group);
+		return true;
+	}));
+	sort(merged.begin(), merged.end());
+	sort(found.begin(), found.end());
+	EXPECT_EQ(merged, found);
+}
+
+// The cliques of "other", each with every node of "nodes", found one node at
+// a time
+vector<vector<petri::iterator> > partials_of(const graph<place, transition, token, state<token> > &g, int composition, vector<petri::iterator> nodes, vector<petri::iterator> other) {
+	vector<vector<petri::iterator> > result;
+	vector<pair<vector<petri::iterator>, vector<petri::iterator> > > stack(1, {nodes, other});
+	while (not stack.empty()) {
+		auto curr = stack.back();
+		stack.pop_back();
+		sort(curr.first.begin(), curr.first.end());
+		if (find(result.begin(), result.end(), curr.first) == result.end()) {
+			result.push_back(curr.first);
+			for (int i = 0; i < (int)curr.second.size(); i++) {
+				if (g.is(composition, vector<petri::iterator>(1, curr.second[i]), curr.first)) {
+					stack.push_back(curr);
+					stack.back().first.push_back(curr.second[i]);
+					stack.back().second.erase(stack.back().second.begin() + i);
+				}
+			}
+		}
+	}
+	sort(result.begin(), result.end());
+	return result;
+}
+
+TEST(select, partials) {
+	vector<petri::iterator> places;
+	auto g = make_branches(3, 2, places);
+	auto h = g;
+	h.set_threads(4);
+
+	vector<petri::iterator> all;
+	for (int type : {place::type, transition::type}) {
+		for (auto i = g.begin(type); i != g.end(type); i++) {
+			all.push_back(i);
+		}
+	}
+
+	// Three branches of two places, two transitions and an end place each,
+	// plus the empty set and the fork, join and link
+	vector<vector<petri::iterator> > result = g.partials(parallel, {});
+	EXPECT_EQ(6*6*6 + 3, (int)result.size());
+	EXPECT_EQ(partials_of(g, parallel, {}, all), result);
+	EXPECT_EQ(result, h.partials(parallel, {}));
+
+	for (int composition : {parallel, choice}) {
+		for (auto node = places.begin(); node != places.end(); node += 2) {
+			// The seed is one of the nodes that may be added when it is in
+			// choice with itself, and is then listed twice
+			vector<petri::iterator> other;
+			for (auto i = all.begin(); i != all.end(); i++) {
+				if (g.is(composition, vector<petri::iterator>(1, *i), {*node})) {
+					other.push_back(*i);
+				}
+			}
+			result = g.partials(composition, {*node});
+			EXPECT_EQ(partials_of(g, composition, {*node}, other), result);
+			EXPECT_EQ(result, h.partials(composition, {*node}));
+			vector<petri::iterator> twice = {*node, *node};
+			EXPECT_EQ(find(other.begin(), other.end(), *node) != other.end(), find(result.begin(), result.end(), twice) != result.end());
+		}
+	}
+}
+
 /* This structure violates liveness
 
 TEST(select, compressed_parallel_choice) {
@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include <petri/graph.h>
+#include <petri/state.h>
+
+using namespace petri;
+using namespace std;
+
+using petri_graph = graph<place, transition, token, state<token> >;
+
+// A ring of parallel fork/join stages
+petri_graph make_ring(int stages) {
+	petri_graph g;
+	auto fork = g.create(transition(), stages);
+	auto join = g.create(transition(), stages);
+	for (int i = 0; i < stages; i++) {
+		auto a = g.create(place(), 2);
+		auto b = g.create(place(), 2);
+		g.connect({fork[i], a[0], join[i]});
+		g.connect({fork[i], b[0], join[i]});
+		g.connect({fork[i], a[1], join[i]});
+		g.connect({fork[i], b[1], join[i]});
+		petri::iterator link = g.create(place());
+		g.connect({join[i], link, fork[(i+1)%stages]});
+		if (i == stages-1) {
+			g.reset.push_back(state<token>({token(link.index)}));
+		}
+	}
+	return g;
+}
+
+// merge_inplace() as it was before it was made linear, editing g0 with
+// vector insert and erase.
+void reference_merge_inplace(int group_operation, int branch_operation, vector<split_group> &g0, const vector<split_group> &g1, set<int> exclude) {
+	int i = 0, j = 0;
+	while (i < (int)g0.size() or j < (int)g1.size()) {
+		while (j < (int)g1.size() and exclude.find(g1[j].split) != exclude.end()) {
+			j++;
+		}
+
+		if (i < (int)g0.size() and j < (int)g1.size() and g0[i].split == g1[j].split) {
+			int k = 0, l = 0;
+			while (k < (int)g0[i].branch.size() or l < (int)g1[j].branch.size()) {
+				if (k < (int)g0[i].branch.size() and l < (int)g1[j].branch.size() and g0[i].branch[k] == g1[j].branch[l]) {
+					k++;
+					l++;
+				} else if (k < (int)g0[i].branch.size() and (l >= (int)g1[j].branch.size() or g0[i].branch[k] < g1[j].branch[l])) {
+					if (branch_operation == split_group::INTERSECT) {
+						g0[i].branch.erase(g0[i].branch.begin()+k);
+					} else {
+						k++;
+					}
+				} else if (l < (int)g1[j].branch.size()) {
+					if (branch_operation == split_group::UNION) {
+						g0[i].branch.insert(g0[i].branch.begin()+k, g1[j].branch[l]);
+						k++;
+					}
+					l++;
+				}
+			}
+			i++;
+			j++;
+		} else if (i < (int)g0.size() and (j >= (int)g1.size() or g0[i].split < g1[j].split)) {
+			if (group_operation == split_group::INTERSECT) {
+				g0.erase(g0.begin()+i);
+			} else {
+				i++;
+			}
+		} else if (j < (int)g1.size()) {
+			if (group_operation == split_group::UNION) {
+				g0.insert(g0.begin()+i, g1[j]);
+				i++;
+			}
+			j++;
+		}
+	}
+}
+
+// Sorted split groups with random splits and branches. Branch j is the
+// j'th successor of its split, so it is also bit j of the mask.
+vector<split_group> random_groups(int splits, int groups, int branches, bool masked = false) {
+	vector<split_group> result;
+	for (int i = 0; i < splits and (int)result.size() < groups; i++) {
+		if (rand()%splits < groups) {
+			split_group group(i, branches);
+			if (masked) {
+				group.mask.assign((branches+63)/64, 0);
+			}
+			for (int j = 0; j < branches; j++) {
+				if (rand()%2) {
+					group.branch.push_back(j);
+					if (masked) {
+						group.set_mask(j);
+					}
+				}
+			}
+			result.push_back(group);
+		}
+	}
+	return result;
+}
+
+vector<split_group> strip_masks(vector<split_group> groups) {
+	for (auto g = groups.begin(); g != groups.end(); g++) {
+		g->mask.clear();
+	}
+	return groups;
+}
+
+const vector<int> compare_groups = {
+	split_group::INTERSECT, split_group::DIFFERENCE, split_group::NEGATIVE_DIFFERENCE,
+	split_group::SYMMETRIC_DIFFERENCE, split_group::SUBSET, split_group::SUBSET_EQUAL};
+const vector<int> compare_branches = {
+	split_group::INTERSECT, split_group::DIFFERENCE, split_group::NEGATIVE_DIFFERENCE,
+	split_group::SYMMETRIC_DIFFERENCE, split_group::SUBSET, split_group::SUBSET_EQUAL,
+	split_group::NOT_EQUAL};
+
+const vector<int> group_operations = {split_group::INTERSECT, split_group::UNION};
+const vector<int> branch_operations = {split_group::INTERSECT, split_group::UNION, split_group::DIFFERENCE};
+
+TEST(split_group, merge_inplace) {
+	srand(0);
+	vector<split_group> scratch;
+	for (int iter = 0; iter < 200; iter++) {
+		vector<split_group> g0 = random_groups(20, 10, 6);
+		vector<split_group> g1 = random_groups(20, 10, 6);
+		set<int> exclude;
+		for (int i = 0; i < 3; i++) {
+			exclude.insert(rand()%20);
+		}
+		vector<int> sorted(exclude.begin(), exclude.end());
+
+		for (int group_operation : group_operations) {
+			for (int branch_operation : branch_operations) {
+				vector<split_group> expect = g0, actual = g0;
+				reference_merge_inplace(group_operation, branch_operation, expect, g1, exclude);
+				merge_inplace(group_operation, branch_operation, actual, g1, sorted, scratch);
+				ASSERT_EQ(expect.size(), actual.size());
+				for (int i = 0; i < (int)expect.size(); i++) {
+					EXPECT_EQ(expect[i], actual[i]);
+					EXPECT_EQ(expect[i].count, actual[i].count);
+				}
+			}
+		}
+	}
+}
+
+TEST(split_group, masks) {
+	// The branch masks give the same answers as the branch lists
+	srand(2);
+	vector<split_group> scratch;
+	for (int iter = 0; iter < 100; iter++) {
+		int branches = 1 + rand()%150;
+		vector<split_group> g0 = random_groups(20, 10, branches, true);
+		vector<split_group> g1 = random_groups(20, 10, branches, true);
+		vector<split_group> l0 = strip_masks(g0), l1 = strip_masks(g1);
+
+		for (int group_operation : compare_groups) {
+			for (int branch_operation : compare_branches) {
+				EXPECT_EQ(compare(group_operation, branch_operation, l0, l1), compare(group_operation, branch_operation, g0, g1));
+			}
+		}
+
+		for (int group_operation : group_operations) {
+			for (int branch_operation : branch_operations) {
+				vector<split_group> merged = petri::merge(group_operation, branch_operation, g0, g1);
+				vector<split_group> inplace = g0;
+				merge_inplace(group_operation, branch_operation, inplace, g1, span<const int>(), scratch);
+				for (const vector<split_group> *result : {&merged, &inplace}) {
+					for (auto g = result->begin(); g != result->end(); g++) {
+						split_group expect(g->split, g->count);
+						expect.mask.assign((g->count+63)/64, 0);
+						for (auto b = g->branch.begin(); b != g->branch.end(); b++) {
+							expect.set_mask(*b);
+						}
+						EXPECT_TRUE(g->has_mask());
+						EXPECT_EQ(expect.mask, g->mask);
+					}
+				}
+			}
+		}
+	}
+
+	// the graph fills in the masks of the groups it computes
+	petri_graph ring = make_ring(3);
+	ring.compute_split_groups();
+	for (int composition = 0; composition < 2; composition++) {
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = ring.begin(type); i != ring.end(type); i++) {
+				span<const split_group> groups = ring.split_groups_view(composition, i);
+				for (auto g = groups.begin(); g != groups.end(); g++) {
+					EXPECT_TRUE(g->has_mask()) << *g;
+				}
+			}
+		}
+	}
+
+	// a mask left behind by an edit to branch is not used
+	split_group g(0, 4, {0, 1});
+	g.set_mask(0);
+	g.set_mask(1);
+	EXPECT_TRUE(g.has_mask());
+	g.branch.push_back(3);
+	EXPECT_FALSE(g.has_mask());
+}
+
+TEST(split_group, views) {
+	vector<split_group> g0 = {split_group(0, 3, {0, 1}), split_group(2, 2, {0}), split_group(5, 2, {1})};
+	vector<split_group> g1 = {split_group(0, 3, {1, 2}), split_group(5, 2, {0, 1}), split_group(7, 2, {0})};
+
+	// merging into a reused buffer matches merging into a new vector
+	vector<split_group> buffer = {split_group(9, 4, {0, 1, 2, 3}), split_group(10, 2, {1}), split_group(11, 2), split_group(12, 2)};
+	for (int group_operation : {split_group::INTERSECT, split_group::UNION}) {
+		for (int branch_operation : {split_group::INTERSECT, split_group::UNION, split_group::DIFFERENCE}) {
+			vector<split_group> expect = petri::merge(group_operation, branch_operation, g0, g1);
+			petri::merge(group_operation, branch_operation, g0, g1, buffer);
+			ASSERT_EQ(expect.size(), buffer.size());
+			for (int i = 0; i < (int)expect.size(); i++) {
+				EXPECT_EQ(expect[i], buffer[i]);
+				EXPECT_EQ(expect[i].count, buffer[i].count);
+			}
+		}
+	}
+
+	// a view of part of the groups
+	span<const split_group> tail(g0.data()+1, 2);
+	EXPECT_TRUE(compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, g0, g1));
+	EXPECT_FALSE(compare(split_group::INTERSECT, split_group::SYMMETRIC_DIFFERENCE, tail, g1));
+}
+
+TEST(split_group, pool) {
+	// nodes share an entry exactly when they have the same groups, and the
+	// owner of each entry has its groups
+	srand(3);
+	for (int iter = 0; iter < 100; iter++) {
+		int branches = 1 + rand()%4;
+		vector<vector<split_group> > nodes;
+		for (int i = 0; i < 6; i++) {
+			nodes.push_back(random_groups(4, rand()%3, branches, i%2 == 0));
+		}
+
+		auto groups_of = [&nodes](int type, int index) {
+			return span<const split_group>(nodes[type*3 + index]);
+		};
+		split_pool pool;
+		for (int i = 0; i < 6; i++) {
+			pool.push(i/3, i%3, nodes[i], groups_of);
+		}
+
+		for (int i = 0; i < 6; i++) {
+			int k = pool.id(i/3, i%3);
+			ASSERT_GE(k, 0);
+			ASSERT_LT(k, pool.entries());
+			pair<int, int> owner = pool.owner[k];
+			EXPECT_EQ(nodes[i], nodes[owner.first*3 + owner.second]);
+			for (int j = 0; j < 6; j++) {
+				EXPECT_EQ(nodes[i] == nodes[j], k == pool.id(j/3, j%3));
+			}
+		}
+		EXPECT_EQ(-1, pool.id(place::type, 3));
+	}
+
+	// the graph rebuilds its pools after the split groups change
+	petri_graph ring = make_ring(3);
+	ring.compute_split_groups();
+	EXPECT_TRUE(ring.update_split_pools());
+	petri::iterator p = ring.begin(place::type);
+	int before = ring.split_pools[parallel].id(p.type, p.index);
+	EXPECT_GE(before, 0);
+	ring.set_split_group(parallel, p, split_group(100, 2, {0}));
+	EXPECT_FALSE(ring.update_split_pools(false));
+	EXPECT_TRUE(ring.update_split_pools());
+	int after = ring.split_pools[parallel].id(p.type, p.index);
+	pair<int, int> owner = ring.split_pools[parallel].owner[after];
+	EXPECT_EQ(ring.split_groups_of(parallel, p), ring.split_groups_of(parallel, petri::iterator(owner.first, owner.second)));
+	EXPECT_EQ(1, (int)count(ring.split_pools[parallel].ids[p.type].begin(), ring.split_pools[parallel].ids[p.type].end(), after));
+}
+
+TEST(split_group, interning) {
+	// identical lists of groups are stored once
+	vector<split_group> g0 = {split_group(0, 3, {0, 1}), split_group(5, 2, {1})};
+	vector<split_group> g1 = {split_group(0, 3, {0, 2}), split_group(5, 2, {1})};
+	vector<split_group> none;
+	auto groups_of = [&](int type, int index) {
+		return span<const split_group>(type == place::type ? (index == 0 ? g0 : g1) : (index == 0 ? g0 : none));
+	};
+	split_pool pool;
+	int a = pool.push(place::type, 0, g0, groups_of);
+	int b = pool.push(place::type, 1, g1, groups_of);
+	int c = pool.push(transition::type, 0, g0, groups_of);
+	int d = pool.push(transition::type, 1, none, groups_of);
+	EXPECT_NE(a, b);
+	EXPECT_EQ(a, c);
+	EXPECT_NE(a, d);
+	EXPECT_EQ(3, pool.entries());
+	EXPECT_EQ(make_pair(place::type, 0), pool.owner[c]);
+	EXPECT_EQ(c, pool.id(transition::type, 0));
+	EXPECT_EQ(-1, pool.id(transition::type, 2));
+
+	// the places along one branch of a ring share their groups
+	petri_graph ring = make_ring(4);
+	ring.update_split_pools();
+	for (int composition = 0; composition < 2; composition++) {
+		EXPECT_LT(ring.split_pools[composition].entries(), ring.size());
+		for (int type = 0; type < 2; type++) {
+			for (petri::iterator i = ring.begin(type); i != ring.end(type); i++) {
+				for (petri::iterator j = ring.begin(type); j != ring.end(type); j++) {
+					EXPECT_EQ(ring.split_pools[composition].id(i.type, i.index) == ring.split_pools[composition].id(j.type, j.index),
+						ring.split_groups_of(composition, i) == ring.split_groups_of(composition, j));
+				}
+			}
+		}
+	}
+
+	// memoized comparisons give the same answers
+	vector<petri::iterator> nodes;
+	for (int type = 0; type < 2; type++) {
+		for (petri::iterator i = ring.begin(type); i != ring.end(type); i++) {
+			nodes.push_back(i);
+		}
+	}
+	vector<bool> expect;
+	for (int composition = 0; composition < 5; composition++) {
+		for (auto i = nodes.begin(); i != nodes.end(); i++) {
+			for (auto j = nodes.begin(); j != nodes.end(); j++) {
+				expect.push_back(ring.is(composition, *i, *j, composition%2 == 0));
+			}
+		}
+	}
+	ring.set_compare_memo(true, 16);
+	for (int pass = 0; pass < 2; pass++) {
+		int k = 0;
+		for (int composition = 0; composition < 5; composition++) {
+			for (auto i = nodes.begin(); i != nodes.end(); i++) {
+				for (auto j = nodes.begin(); j != nodes.end(); j++) {
+					EXPECT_EQ(expect[k++], ring.is(composition, *i, *j, composition%2 == 0));
+				}
+			}
+		}
+	}
+	EXPECT_EQ(16, (int)ring.compare_results.size());
+}
+
+TEST(split_group, signatures) {
+	// groups that share no splits are compared by whether they are missing
+	// branches alone
+	srand(4);
+	int checked = 0;
+	for (int iter = 0; iter < 200; iter++) {
+		vector<split_group> g0 = random_groups(20, 3, 3);
+		vector<split_group> g1 = random_groups(20, 3, 3);
+		for (auto &g : g1) {
+			g.split += 20;
+		}
+
+		// the signatures may overlap even though the splits don't
+		auto groups_of = [&](int type, int index) {
+			return span<const split_group>(index == 0 ? g0 : g1);
+		};
+		split_pool pool;
+		int i = pool.push(place::type, 0, g0, groups_of);
+		int j = pool.push(place::type, 1, g1, groups_of);
+		if ((pool.signature[i] & pool.signature[j]) != 0) {
+			continue;
+		}
+		for (int group_operation : compare_groups) {
+			for (int branch_operation : compare_branches) {
+				bool result;
+				if (compare_disjoint(group_operation, branch_operation, pool.partial[i], pool.partial[j], result)) {
+					EXPECT_EQ(compare(group_operation, branch_operation, g0, g1), result);
+					checked++;
+				}
+			}
+		}
+	}
+	EXPECT_GT(checked, 0);
+
+	// nodes in different stages of a ring share no splits
+	petri_graph g = make_ring(3);
+	g.update_split_pools();
+	g.set_signature_stats(true);
+	vector<petri::iterator> nodes;
+	for (int type = 0; type < 2; type++) {
+		for (petri::iterator i = g.begin(type); i != g.end(type); i++) {
+			nodes.push_back(i);
+		}
+	}
+	for (auto a = nodes.begin(); a != nodes.end(); a++) {
+		for (auto b = nodes.begin(); b != nodes.end(); b++) {
+			g.is(parallel, *a, *b);
+		}
+	}
+	EXPECT_GT(g.signature_hit_rate(), 0.0);
+	EXPECT_LT(g.signature_hit_rate(), 1.0);
+}